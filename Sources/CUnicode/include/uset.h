@@ -0,0 +1,173 @@
+/*
+**********************************************************************
+*   Copyright (C) 2002-2014, International Business Machines
+*   Corporation and others.  All Rights Reserved.
+**********************************************************************
+*/
+
+#ifndef USET_H
+#define USET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "uerror.h"
+
+#ifndef CF_OPTIONS
+#define CF_OPTIONS(_type, _name) enum _name : _type _name; enum _name : _type
+#endif
+
+#pragma clang assume_nonnull begin
+
+/**
+ * USet is the C API type corresponding to C++ class UnicodeSet.
+ * Use the uset_* API to manipulate.  Create with
+ * uset_open*, and destroy with uset_close.
+ * @stable ICU 2.4
+ */
+typedef struct _USet {} USet;
+
+/**
+ * Bitmask values to be passed to uset_openPatternOptions() or
+ * uset_applyPattern() taking an option parameter.
+ * @stable ICU 2.4
+ */
+typedef CF_OPTIONS(int32_t, USetAttributes) {
+    /**
+     * Ignore white space within patterns unless quoted or escaped.
+     * @stable ICU 2.4
+     */
+    USET_IGNORE_SPACE U_SWIFT_NAME(ignoreSpace) = 1,
+
+    /**
+     * Enable case insensitive matching.  E.g., "[ab]" with this flag
+     * will match 'a', 'A', 'b', and 'B'.  "[^ab]" with this flag will
+     * match all except 'a', 'A', 'b', and 'B'. This performs a full
+     * closure over case mappings, e.g. U+017F for s.
+     * @stable ICU 2.4
+     */
+    USET_CASE_INSENSITIVE U_SWIFT_NAME(caseInsensitive) = 2,
+
+    /**
+     * Enable case insensitive matching.  E.g., "[ab]" with this flag
+     * will match 'a', 'A', 'b', and 'B'.  "[^ab]" with this flag will
+     * match all except 'a', 'A', 'b', and 'B'. This adds the lower-,
+     * title-, and uppercase mappings as well as the case folding
+     * of each existing element in the set.
+     * @stable ICU 3.2
+     */
+    USET_ADD_CASE_MAPPINGS U_SWIFT_NAME(addCaseMappings) = 4
+} U_SWIFT_NAME(USet.Attributes);
+
+/**
+ * Creates an empty USet object.
+ * Equivalent to uset_open(1, 0).
+ * @return a newly created USet.  The caller must call uset_close() on
+ * it when done.
+ * @stable ICU 4.2
+ */
+extern U_SWIFT_NAME(USet.openEmpty())
+USet *
+uset_openEmpty(void);
+
+/**
+ * Creates a set from the given pattern.  See the UnicodeSet class
+ * description for the syntax of the pattern language.
+ * @param pattern a string specifying what characters are in the set
+ * @param patternLength the length of the pattern, or -1 if null
+ * terminated
+ * @param ec the error code
+ * @stable ICU 2.4
+ */
+extern U_SWIFT_NAME(USet.open(pattern:length:status:))
+USet *_Nullable
+uset_openPattern(const uint16_t *pattern, int32_t patternLength,
+                 UErrorCode *ec);
+
+/**
+ * Disposes of the storage used by a USet object.  This function should
+ * be called exactly once for objects returned by uset_open().
+ * @param set the object to dispose of
+ * @stable ICU 2.4
+ */
+extern U_SWIFT_NAME(USet.close(self:))
+void
+uset_close(USet *set);
+
+/**
+ * Adds the given range of characters to the given USet.  After this call,
+ * uset_contains(set, start, end) will return TRUE.
+ * A frozen set will not be modified.
+ * @param set the object to which to add the character
+ * @param start the first character of the range to add, inclusive
+ * @param end the last character of the range to add, inclusive
+ * @stable ICU 2.2
+ */
+extern U_SWIFT_NAME(USet.addRange(self:_:_:))
+void
+uset_addRange(USet *set, int32_t start, int32_t end);
+
+/**
+ * Close this set over the given attribute.  For the attribute
+ * USET_CASE, the result is to modify this set so that:
+ *
+ * 1. For each character or string 'a' in this set, all strings
+ * 'b' such that foldCase(a) == foldCase(b) are added to this set.
+ * (For most 'a' that are single characters, 'b' will have
+ * b.length() == 1.)
+ *
+ * 2. For each string 'e' in the resulting set, if e !=
+ * foldCase(e), 'e' will be removed.
+ *
+ * A frozen set will not be modified.
+ *
+ * @param set the set
+ *
+ * @param attributes bitmask for attributes to close over.
+ * Currently only the USET_CASE bit is supported.  Any undefined bits
+ * are ignored.
+ * @stable ICU 4.2
+ */
+extern U_SWIFT_NAME(USet.closeOver(self:_:))
+void
+uset_closeOver(USet *set, USetAttributes attributes);
+
+/**
+ * Returns the number of items in this set.  An item is either a range
+ * of characters or a single multicharacter string.
+ * @param set the set
+ * @return a non-negative integer counting the character ranges
+ * and/or strings contained in set
+ * @stable ICU 2.4
+ */
+extern U_SWIFT_NAME(USet.itemCount(self:))
+int32_t
+uset_getItemCount(const USet *set);
+
+/**
+ * Returns an item of this set.  An item is either a range of
+ * characters or a single multicharacter string.
+ * @param set the set
+ * @param itemIndex a non-negative integer in the range 0..
+ * uset_getItemCount(set)-1
+ * @param start pointer to variable to receive first character
+ * in range, inclusive
+ * @param end pointer to variable to receive last character in range,
+ * inclusive
+ * @param str buffer to receive the string, may be NULL
+ * @param strCapacity capacity of str, or 0 if str is NULL
+ * @param ec error code
+ * @return the length of the string (>= 2), or 0 if the item is a
+ * range, in which case it is the range *start..*end, or -1 if
+ * itemIndex is out of range
+ * @stable ICU 2.4
+ */
+extern U_SWIFT_NAME(USet.item(self:at:start:end:string:capacity:status:))
+int32_t
+uset_getItem(const USet *set, int32_t itemIndex,
+             int32_t *start, int32_t *end,
+             uint16_t *_Nullable str, int32_t strCapacity,
+             UErrorCode *ec);
+
+#pragma clang assume_nonnull end
+
+#endif
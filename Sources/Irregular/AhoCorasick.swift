@@ -0,0 +1,182 @@
+//
+//  AhoCorasick.swift
+//  Irregular
+//
+
+/// An Aho-Corasick automaton over UTF-16 code units, for finding which of
+/// many literals occur in a text in one pass.
+final class AhoCorasick {
+
+    enum Representation {
+        /// A transition for every state and every code unit that occurs in
+        /// the literals, with failures resolved ahead of time, so each code
+        /// unit of the text takes one lookup.
+        case dense
+        /// Only each state's own transitions, sorted, with failure links
+        /// followed on a miss: much less memory for large literal sets.
+        case compact
+    }
+
+    /// Tables with more transitions than this are compact when the
+    /// representation is chosen automatically.
+    static let maximumDenseTransitions = 1 << 20
+
+    let literals: [[UInt16]]
+    let representation: Representation
+
+    private let stateCount: Int
+    private var failure = ContiguousArray<Int32>()
+
+    /// The literals that end at each state, including through its failure
+    /// links.
+    private var outputs = [[Int32]]()
+    private var hasOutput = ContiguousArray<Bool>()
+
+    // Dense: the class of each code unit, where class 0 is every unit that
+    // doesn't occur in a literal, and the next state for each state and class.
+    private var classes = ContiguousArray<UInt16>()
+    private var classCount = 0
+    private var table = ContiguousArray<Int32>()
+
+    // Compact: each state's transitions are `edgeUnits[edgeStarts[state] ..<
+    // edgeStarts[state + 1]]`, sorted, and the matching `edgeTargets`.
+    private var edgeStarts = ContiguousArray<Int32>()
+    private var edgeUnits = ContiguousArray<UInt16>()
+    private var edgeTargets = ContiguousArray<Int32>()
+
+    /// - parameter representation: How to store transitions, or `nil` to
+    ///   choose by the size of the dense table.
+    init(literals: [[UInt16]], representation: Representation? = nil) {
+        self.literals = literals
+
+        var trie: [[UInt16: Int32]] = [[:]]
+        var own: [[Int32]] = [[]]
+        var units = Swift.Set<UInt16>()
+        for (id, literal) in literals.enumerated() where !literal.isEmpty {
+            var state = 0
+            for unit in literal {
+                units.insert(unit)
+                if let next = trie[state][unit] {
+                    state = Int(next)
+                } else {
+                    trie[state][unit] = Int32(trie.count)
+                    state = trie.count
+                    trie.append([:])
+                    own.append([])
+                }
+            }
+            own[state].append(Int32(id))
+        }
+        self.stateCount = trie.count
+
+        // States in breadth-first order, so every state's failure comes
+        // before it.
+        var order = [0]
+        var failure = ContiguousArray<Int32>(repeating: 0, count: stateCount)
+        var outputs = own
+        var head = 0
+        while head < order.count {
+            let state = order[head]
+            head += 1
+            for (unit, child) in trie[state] {
+                order.append(Int(child))
+                guard state != 0 else { continue }
+                var fallback = Int(failure[state])
+                while fallback != 0 && trie[fallback][unit] == nil {
+                    fallback = Int(failure[fallback])
+                }
+                let target = trie[fallback][unit] ?? 0
+                failure[Int(child)] = target
+                outputs[Int(child)] += outputs[Int(target)]
+            }
+        }
+        self.failure = failure
+        self.outputs = outputs
+        self.hasOutput = ContiguousArray(outputs.map { !$0.isEmpty })
+
+        let sortedUnits = units.sorted()
+        let denseSize = stateCount * (sortedUnits.count + 1)
+        self.representation = representation ?? (denseSize <= AhoCorasick.maximumDenseTransitions ? .dense : .compact)
+
+        switch self.representation {
+        case .dense:
+            classCount = sortedUnits.count + 1
+            classes = ContiguousArray(repeating: 0, count: 1 << 16)
+            for (index, unit) in sortedUnits.enumerated() {
+                classes[Int(unit)] = UInt16(index + 1)
+            }
+            table = ContiguousArray(repeating: 0, count: stateCount * classCount)
+            for state in order {
+                for (index, unit) in sortedUnits.enumerated() {
+                    let next: Int32
+                    if let child = trie[state][unit] {
+                        next = child
+                    } else if state == 0 {
+                        next = 0
+                    } else {
+                        next = table[Int(failure[state]) * classCount + index + 1]
+                    }
+                    table[state * classCount + index + 1] = next
+                }
+            }
+        case .compact:
+            for state in 0 ..< stateCount {
+                edgeStarts.append(Int32(edgeUnits.count))
+                for (unit, child) in trie[state].sorted(by: { $0.key < $1.key }) {
+                    edgeUnits.append(unit)
+                    edgeTargets.append(child)
+                }
+            }
+            edgeStarts.append(Int32(edgeUnits.count))
+        }
+    }
+
+    /// The state's own transition on `unit`, by binary search.
+    private func edge(from state: Int, on unit: UInt16) -> Int32? {
+        var low = Int(edgeStarts[state]), high = Int(edgeStarts[state + 1])
+        while low < high {
+            let middle = (low + high) / 2
+            if edgeUnits[middle] < unit {
+                low = middle + 1
+            } else {
+                high = middle
+            }
+        }
+        return low < Int(edgeStarts[state + 1]) && edgeUnits[low] == unit ? edgeTargets[low] : nil
+    }
+
+    private func next(from state: Int, on unit: UInt16) -> Int {
+        switch representation {
+        case .dense:
+            return Int(table[state * classCount + Int(classes[Int(unit)])])
+        case .compact:
+            var state = state
+            while true {
+                if let target = edge(from: state, on: unit) {
+                    return Int(target)
+                } else if state == 0 {
+                    return 0
+                }
+                state = Int(failure[state])
+            }
+        }
+    }
+
+    /// Returns which literals occur in `units[start ..< end]`, by index.
+    func occurringLiterals(in units: UnsafeBufferPointer<UInt16>, from start: Int, to end: Int) -> [Bool] {
+        var occurs = [Bool](repeating: false, count: literals.count)
+        var reported = [Bool](repeating: false, count: stateCount)
+        var state = 0
+        for i in start ..< end {
+            state = next(from: state, on: units[i])
+            if hasOutput[state] && !reported[state] {
+                reported[state] = true
+                for literal in outputs[state] {
+                    occurs[Int(literal)] = true
+                }
+            }
+        }
+        return occurs
+    }
+
+}
@@ -0,0 +1,104 @@
+//
+//  AsyncMatches.swift
+//  Irregular
+//
+
+import Dispatch
+
+extension RegularExpression {
+
+    /// Matches delivered asynchronously on a dispatch queue.
+    ///
+    /// A long scan is split into many small work items: after delivering
+    /// `batchSize` matches, or after a search has advanced over a few
+    /// thousand start positions without finding one, the scan is re-enqueued
+    /// so other work on the queue gets a turn. Cancellation is polled from
+    /// ICU's callbacks and the native engines' checks, so even a single slow
+    /// search stops promptly.
+    public final class AsyncMatches {
+
+        /// How many start positions a search passes over without a match
+        /// before it yields the queue. Stopping and resuming a search costs
+        /// far more than trying one position, so this is much larger than a
+        /// typical batch of matches.
+        static let progressInterval = 16_384
+
+        private var matches: Matches
+        private let queue: DispatchQueue
+        private let batchSize: Int
+        private let cancellation: DispatchWorkItem
+        private var isStarted = false
+
+        fileprivate init(matches: Matches, queue: DispatchQueue, batchSize: Int, cancellation: DispatchWorkItem) {
+            self.matches = matches
+            self.queue = queue
+            self.batchSize = batchSize
+            self.cancellation = cancellation
+        }
+
+        /// Whether `cancel()` has been called.
+        public var isCancelled: Bool {
+            return cancellation.isCancelled
+        }
+
+        /// Stops the scan. The completion handler is called with an `Error`
+        /// whose `interruption` is `.cancelled`, unless the scan had already
+        /// finished. Safe to call from any thread.
+        public func cancel() {
+            cancellation.cancel()
+        }
+
+        /// Starts the scan, calling `body` with each match and `completion`
+        /// once after the last, both on the queue the matches were created
+        /// with. `completion` receives an error if the search was abandoned.
+        ///
+        /// The matches retain themselves until `completion` is called.
+        public func forEach(_ body: @escaping (MatchGroup) -> Void, completion: @escaping (Swift.Error?) -> Void) {
+            precondition(!isStarted, "async matches can only be iterated once")
+            isStarted = true
+            queue.async {
+                self.resume(body, completion: completion)
+            }
+        }
+
+        private func resume(_ body: @escaping (MatchGroup) -> Void, completion: @escaping (Swift.Error?) -> Void) {
+            var delivered = 0
+            do {
+                while true {
+                    switch try matches.step() {
+                    case .match(let group):
+                        body(group)
+                        delivered += 1
+                        guard delivered < batchSize else { break }
+                        continue
+                    case .suspended:
+                        break
+                    case .finished:
+                        completion(nil)
+                        return
+                    }
+
+                    queue.async {
+                        self.resume(body, completion: completion)
+                    }
+                    return
+                }
+            } catch {
+                completion(error)
+            }
+        }
+
+    }
+
+    /// Returns matches in `string` that are delivered asynchronously on
+    /// `queue`, yielding the queue every `batchSize` matches, or in long
+    /// stretches of text without one.
+    public func asyncMatches(in string: String, options: MatchingOptions = [], range: Range<String.Index>? = nil, limits: MatchLimits = MatchLimits(), queue: DispatchQueue, batchSize: Int = 64) throws -> AsyncMatches {
+        precondition(batchSize > 0, "batch size must be positive")
+        let cancellation = DispatchWorkItem {}
+        let monitor = SearchMonitor(limits: limits, cancellation: cancellation, progressInterval: AsyncMatches.progressInterval)
+        let matches = try self.matches(in: string, options: options, range: range, monitor: monitor)
+        return AsyncMatches(matches: matches, queue: queue, batchSize: batchSize, cancellation: cancellation)
+    }
+
+}
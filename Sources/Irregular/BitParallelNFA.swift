@@ -0,0 +1,247 @@
+//
+//  BitParallelNFA.swift
+//  Irregular
+//
+
+/// A Glushkov automaton for small patterns, simulated with one bit per
+/// position in a machine word.
+///
+/// Each literal or set in the pattern, after counted repetitions are
+/// expanded, is a position of the automaton; the active positions after a
+/// character are those that just consumed it. Patterns of up to 64 positions
+/// without assertions, like `Mozilla/[45]\.0 \((iPhone|iPad|Macintosh)`,
+/// advance over the text with a few table lookups, shifts and masks per
+/// character, with no cache to build or fill.
+///
+/// It only answers whether there is a match: a match ends wherever a last
+/// position becomes active, and where it started doesn't matter.
+final class BitParallelNFA {
+
+    /// The first and last positions of a subpattern, and whether it can
+    /// match the empty string.
+    private struct Fragment {
+        var first: UInt64
+        var last: UInt64
+        var isNullable: Bool
+
+        static let empty = Fragment(first: 0, last: 0, isNullable: true)
+    }
+
+    static let maximumPositions = 64
+
+    private static let tableWidth = 128
+
+    /// The monitor is consulted once per this many positions.
+    private static let checkInterval = 4096
+
+    private var sets = [ScalarSet]()
+
+    /// The positions that may follow each position.
+    private var follow = [UInt64]()
+
+    private var first: UInt64 = 0
+    private var last: UInt64 = 0
+    private var isNullable = false
+
+    /// Characters an anchored search may pass over before the pattern
+    /// begins, from the tree's `unanchoredPrefix`.
+    private var unanchoredPrefix: ScalarSet?
+
+    /// For each ASCII character, the positions that consume it.
+    private var asciiMasks = ContiguousArray<UInt64>(repeating: 0, count: BitParallelNFA.tableWidth)
+
+    /// The positions that may follow each value of each byte of the active
+    /// positions, so following a whole word takes eight lookups.
+    private var followTable = ContiguousArray<UInt64>()
+
+    /// The number of positions.
+    var positionCount: Int {
+        return sets.count
+    }
+
+    init?(_ tree: SyntaxTree) {
+        guard tree.features.isDisjoint(with: [.fullCaseFolding, .dotMatchingCRLF]), let root = fragment(tree, tree.root) else { return nil }
+        first = root.first
+        last = root.last
+        isNullable = root.isNullable
+        unanchoredPrefix = tree.unanchoredPrefix?.compiledForLookup()
+
+        for (position, set) in sets.enumerated() {
+            for scalar in 0 ..< UInt32(BitParallelNFA.tableWidth) where set.contains(scalar) {
+                asciiMasks[Int(scalar)] |= 1 << UInt64(position)
+            }
+        }
+
+        followTable = ContiguousArray(repeating: 0, count: 8 * 256)
+        for chunk in 0 ..< 8 {
+            for value in 0 ..< 256 {
+                var positions: UInt64 = 0
+                for bit in 0 ..< 8 where value & (1 << bit) != 0 && chunk * 8 + bit < follow.count {
+                    positions |= follow[chunk * 8 + bit]
+                }
+                followTable[chunk * 256 + value] = positions
+            }
+        }
+    }
+
+    /// Adds `successors` to the follow set of each of `positions`.
+    private func link(_ positions: UInt64, to successors: UInt64) {
+        for position in 0 ..< follow.count where positions & (1 << UInt64(position)) != 0 {
+            follow[position] |= successors
+        }
+    }
+
+    private func concatenate(_ a: Fragment, _ b: Fragment) -> Fragment {
+        link(a.last, to: b.first)
+        return Fragment(first: a.isNullable ? a.first | b.first : a.first,
+                        last: b.isNullable ? a.last | b.last : b.last,
+                        isNullable: a.isNullable && b.isNullable)
+    }
+
+    /// Builds the positions for `node`, returning `nil` if there are too
+    /// many or it needs anything but literals, sets, and repetition.
+    private func fragment(_ tree: SyntaxTree, _ node: SyntaxTree.NodeIndex) -> Fragment? {
+        switch tree[node] {
+        case .empty:
+            return .empty
+        case let .literal(scalar, caseInsensitive):
+            return position(caseInsensitive ? ScalarSet(scalar).caseClosed() : ScalarSet(scalar))
+        case .set(let index):
+            return position(tree.set(at: index))
+        case .capture(_, let body):
+            return fragment(tree, body)
+        case let .concatenation(start, end):
+            var result = Fragment.empty
+            for child in tree.children(from: start, to: end) {
+                guard let next = fragment(tree, child) else { return nil }
+                result = concatenate(result, next)
+            }
+            return result
+        case let .alternation(start, end):
+            var result = Fragment(first: 0, last: 0, isNullable: false)
+            for branch in tree.children(from: start, to: end) {
+                guard let next = fragment(tree, branch) else { return nil }
+                result.first |= next.first
+                result.last |= next.last
+                result.isNullable = result.isNullable || next.isNullable
+            }
+            return result
+        case let .repetition(body, min, max, repetition):
+            // Giving up backtracking changes what matches, not just which.
+            guard repetition != .possessive else { return nil }
+            // A body without positions adds none however often it repeats,
+            // so the limit on positions never stops unrolling it.
+            if BitParallelNFA.hasNoPositions(tree, body) {
+                return .empty
+            }
+            var result = Fragment.empty
+            for _ in 0 ..< min {
+                guard let next = fragment(tree, body) else { return nil }
+                result = concatenate(result, next)
+            }
+            if max < 0 {
+                guard var loop = fragment(tree, body) else { return nil }
+                link(loop.last, to: loop.first)
+                loop.isNullable = true
+                result = concatenate(result, loop)
+            } else if max > min {
+                // `x{0,3}` matches what `x?x?x?` does.
+                for _ in min ..< max {
+                    guard var optional = fragment(tree, body) else { return nil }
+                    optional.isNullable = true
+                    result = concatenate(result, optional)
+                }
+            }
+            return result
+        case .assertion, .lookaround, .atomic, .backreference, .graphemeCluster:
+            return nil
+        }
+    }
+
+    /// Whether `node` matches only the empty string without any positions,
+    /// like `(?:)` or `a{0}`.
+    private static func hasNoPositions(_ tree: SyntaxTree, _ node: SyntaxTree.NodeIndex) -> Bool {
+        switch tree[node] {
+        case .empty:
+            return true
+        case .capture(_, let body):
+            return hasNoPositions(tree, body)
+        case let .concatenation(start, end), let .alternation(start, end):
+            return !tree.children(from: start, to: end).contains { !hasNoPositions(tree, $0) }
+        case let .repetition(body, _, max, repetition):
+            return repetition != .possessive && (max == 0 || hasNoPositions(tree, body))
+        default:
+            return false
+        }
+    }
+
+    private func position(_ set: ScalarSet) -> Fragment? {
+        guard sets.count < BitParallelNFA.maximumPositions else { return nil }
+        let bit = UInt64(1) << UInt64(sets.count)
+        sets.append(set.compiledForLookup())
+        follow.append(0)
+        return Fragment(first: bit, last: bit, isNullable: false)
+    }
+
+    private func mask(for scalar: UInt32) -> UInt64 {
+        if scalar < UInt32(BitParallelNFA.tableWidth) {
+            return asciiMasks[Int(scalar)]
+        }
+        var positions: UInt64 = 0
+        for (position, set) in sets.enumerated() where set.contains(scalar) {
+            positions |= 1 << UInt64(position)
+        }
+        return positions
+    }
+
+    private func followers(of active: UInt64) -> UInt64 {
+        var positions: UInt64 = 0
+        var remaining = active
+        var chunk = 0
+        while remaining != 0 {
+            positions |= followTable[chunk * 256 + Int(remaining & 0xFF)]
+            remaining >>= 8
+            chunk += 1
+        }
+        return positions
+    }
+
+    /// Returns whether a match begins at or after `start`, or exactly at
+    /// `start` if `anchored`.
+    ///
+    /// Returns `false` if `monitor` asks to stop.
+    func containsMatch(in input: SearchInput, from start: Int, anchored: Bool, monitor: SearchMonitor?) -> Bool {
+        guard !isNullable else { return true }
+        var active: UInt64 = 0
+        var position = start
+        var positionsScanned = 0
+        // An anchored search may still begin after characters of the
+        // unanchored prefix.
+        var isSeeding = true
+        while position < input.end {
+            let (scalar, width) = input.scalar(at: position, limit: input.end)
+            var reachable = followers(of: active)
+            if !anchored || isSeeding {
+                reachable |= first
+            }
+            active = reachable & mask(for: scalar)
+            if active & last != 0 {
+                return true
+            }
+            if anchored && isSeeding {
+                isSeeding = unanchoredPrefix?.contains(scalar) ?? false
+            }
+            if active == 0 && anchored && !isSeeding {
+                return false
+            }
+            position += width
+
+            positionsScanned += 1
+            if let monitor = monitor, positionsScanned % BitParallelNFA.checkInterval == 0, !monitor.shouldContinue(steps: positionsScanned / 10_000) {
+                return false
+            }
+        }
+        return false
+    }
+
+}
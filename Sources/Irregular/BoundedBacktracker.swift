@@ -0,0 +1,185 @@
+//
+//  BoundedBacktracker.swift
+//  Irregular
+//
+
+/// A backtracking matcher that explores a `Program` depth-first, like ICU,
+/// but remembers every (instruction, position) pair it has visited.
+///
+/// A pair that was visited once and didn't lead to a match never will, since
+/// programs have no backreferences, so each is explored at most once and a
+/// search takes time proportional to the length of the text times the size
+/// of the program. That bookkeeping is one bit per pair, so the backtracker
+/// is only used where it fits a memory budget: on short text, where it
+/// avoids the Pike VM's per-position thread lists.
+///
+/// Each word of the visited set is stamped with the search that last wrote
+/// it, and a word stamped by an earlier search reads as empty. Starting a
+/// search only moves to the next stamp, so finding many matches in a row
+/// doesn't clear the set for the rest of the text each time.
+final class BoundedBacktracker {
+
+    private enum Frame {
+        case explore(Int32, Int)
+        case restore(Int32, Int)
+    }
+
+    /// The monitor is consulted once per this many steps.
+    private static let checkInterval = 4096
+
+    let program: Program
+    let memoryBudget: Int
+    private var visited = ContiguousArray<UInt64>()
+    private var stamps = ContiguousArray<UInt32>()
+    private var generation: UInt32 = 0
+    private var stack = [Frame]()
+    private var slots: ContiguousArray<Int>
+
+    /// The first position of the text being searched, and the number of
+    /// positions tracked for each instruction.
+    private var origin = 0
+    private var stride = 0
+
+    /// Explored pairs, for `MatchLimits.maximumSteps`, which counts in units
+    /// of ten thousand like ICU's match callback.
+    private var work = 0
+
+    /// - parameter memoryBudget: The most memory, in bytes, the visited set
+    ///   may use.
+    init(program: Program, memoryBudget: Int) {
+        self.program = program
+        self.memoryBudget = memoryBudget
+        self.slots = ContiguousArray(repeating: -1, count: program.slotCount)
+    }
+
+    /// The longest text, in code units, a search of `program` fits in
+    /// `memoryBudget` bytes, counting each 8-byte visited word and its 4-byte
+    /// stamp; negative if none does.
+    static func maximumLength(for program: Program, memoryBudget: Int) -> Int {
+        let (bits, overflow) = Int.multiplyWithOverflow(memoryBudget / 12, 64)
+        return (overflow ? Int.max : bits) / program.instructions.count - 1
+    }
+
+    /// Whether a search of `length` code units fits in `memoryBudget` bytes.
+    static func fits(_ program: Program, length: Int, memoryBudget: Int) -> Bool {
+        return length <= maximumLength(for: program, memoryBudget: memoryBudget)
+    }
+
+    /// Whether a search of `input` from `start` fits in `memoryBudget`.
+    func fits(_ input: SearchInput, from start: Int) -> Bool {
+        return BoundedBacktracker.fits(program, length: input.end - start, memoryBudget: memoryBudget)
+    }
+
+    /// Marks `pc` at `position` as visited, returning false if it already
+    /// was.
+    private func visit(_ pc: Int32, at position: Int) -> Bool {
+        let bit = Int(pc) * stride + (position - origin)
+        let word = bit >> 6
+        let mask = UInt64(1) << UInt64(bit & 63)
+        if stamps[word] != generation {
+            stamps[word] = generation
+            visited[word] = 0
+        }
+        guard visited[word] & mask == 0 else { return false }
+        visited[word] |= mask
+        return true
+    }
+
+    /// Follows the program from `pc` at `position`, preferring the first
+    /// branch of every split and queueing the second to try on failure.
+    private func step(_ pc: Int32, at position: Int, input: SearchInput) -> Bool {
+        var pc = pc
+        var position = position
+        while visit(pc, at: position) {
+            work += 1
+            switch program.instructions[Int(pc)] {
+            case .scalar(let expected):
+                guard position < input.end else { return false }
+                let decoded = input.scalar(at: position, limit: input.end)
+                guard decoded.value == expected else { return false }
+                position += decoded.width
+                pc += 1
+            case .set(let index):
+                guard position < input.end else { return false }
+                let decoded = input.scalar(at: position, limit: input.end)
+                guard program.sets[Int(index)].contains(decoded.value) else { return false }
+                position += decoded.width
+                pc += 1
+            case let .split(preferred, alternative):
+                stack.append(.explore(alternative, position))
+                pc = preferred
+            case .jump(let target):
+                pc = target
+            case .save(let slot):
+                stack.append(.restore(slot, slots[Int(slot)]))
+                slots[Int(slot)] = position
+                pc += 1
+            case .assertion(let assertion):
+                guard input.holds(assertion, at: position) else { return false }
+                pc += 1
+            case .match:
+                return true
+            }
+        }
+        return false
+    }
+
+    /// Returns the capture slots of the first match that begins at or after
+    /// `start`, or exactly at `start` if `anchored`.
+    ///
+    /// The search must `fit`. Returns `nil` without a match if `monitor`
+    /// asks to stop.
+    func search(_ input: SearchInput, from start: Int, anchored: Bool, monitor: SearchMonitor?) -> ContiguousArray<Int>? {
+        precondition(fits(input, from: start), "search exceeds the backtracking memory budget")
+        origin = start
+        stride = input.end - start + 1
+        let words = (program.instructions.count * stride + 63) / 64
+        if visited.count < words {
+            visited = ContiguousArray(repeating: 0, count: words)
+            stamps = ContiguousArray(repeating: 0, count: words)
+            generation = 0
+        }
+        generation = generation &+ 1
+        if generation == 0 {
+            for i in 0 ..< stamps.count {
+                stamps[i] = 0
+            }
+            generation = 1
+        }
+        work = 0
+        var nextCheck = BoundedBacktracker.checkInterval
+
+        var position = start
+        while true {
+            let canStart = anchored ? position == start : (!program.isAnchoredAtStart || position == input.anchorStart)
+            if canStart {
+                for i in 0 ..< slots.count {
+                    slots[i] = -1
+                }
+                stack.removeAll(keepingCapacity: true)
+                stack.append(.explore(0, position))
+                while let frame = stack.popLast() {
+                    switch frame {
+                    case let .restore(slot, value):
+                        slots[Int(slot)] = value
+                    case let .explore(pc, at):
+                        if step(pc, at: at, input: input) {
+                            return slots
+                        }
+                    }
+
+                    if let monitor = monitor, work >= nextCheck {
+                        nextCheck = work + BoundedBacktracker.checkInterval
+                        guard monitor.shouldContinue(steps: work / 10_000) else { return nil }
+                    }
+                }
+            }
+
+            if anchored || (program.isAnchoredAtStart && position >= input.anchorStart) || position >= input.end {
+                return nil
+            }
+            position += input.scalar(at: position, limit: input.end).width
+        }
+    }
+
+}
@@ -0,0 +1,128 @@
+//
+//  BucketLiteralSearcher.swift
+//  Irregular
+//
+
+/// Finds where any of a few literals occur, with the bucket tables of
+/// Hyperscan's Teddy.
+///
+/// The literals are sorted into eight buckets. For each of the first few
+/// code units of a literal, a table maps the low byte of a code unit of the
+/// text to the buckets with a literal that has that byte there; ANDing the
+/// tables for consecutive code units gives the buckets that might match at
+/// a position, and only positions with some are compared against the
+/// literals.
+///
+/// Teddy looks up sixteen positions at once with SIMD shuffles. Swift has
+/// no portable vector types, so this tests one position at a time: it's a
+/// scalar filter, faster than comparing every literal only because most
+/// positions have no bucket.
+struct BucketLiteralSearcher {
+
+    /// With more literals than this, buckets fill up and so many positions
+    /// become candidates that an Aho-Corasick automaton is faster: scanning
+    /// 8 MB of English-like text for literals of five to nine code units,
+    /// the filter ran at about twice the automaton's speed for up to eight
+    /// literals, broke even at 32, and fell to under half of it at 64.
+    static let maximumLiterals = 32
+
+    private static let bucketCount = 8
+
+    let literals: [[UInt16]]
+
+    /// How many leading code units of each literal the tables cover.
+    private let fingerprintLength: Int
+
+    /// For each of the first `fingerprintLength` code units, the buckets
+    /// with a literal whose code unit there has each low byte.
+    private var tables: ContiguousArray<UInt8>
+
+    /// The literals in each bucket, by index.
+    private var buckets = [[Int]](repeating: [], count: BucketLiteralSearcher.bucketCount)
+
+    init?(literals: [[UInt16]]) {
+        guard !literals.isEmpty, literals.count <= BucketLiteralSearcher.maximumLiterals, let shortest = literals.map({ $0.count }).min(), shortest > 0 else { return nil }
+        self.literals = literals
+        self.fingerprintLength = min(3, shortest)
+        self.tables = ContiguousArray(repeating: 0, count: fingerprintLength * 256)
+
+        // Literals with similar beginnings share buckets, so they make fewer
+        // candidates together.
+        let order = literals.indices.sorted { literals[$0].lexicographicallyPrecedes(literals[$1]) }
+        for (rank, literal) in order.enumerated() {
+            let bucket = rank * BucketLiteralSearcher.bucketCount / literals.count
+            buckets[bucket].append(literal)
+            for k in 0 ..< fingerprintLength {
+                tables[k * 256 + Int(literals[literal][k] & 0xFF)] |= UInt8(1 << bucket)
+            }
+        }
+    }
+
+    /// The buckets that might have a literal beginning at `i`.
+    private func bucketMask(in haystack: UnsafeBufferPointer<UInt16>, at i: Int) -> UInt8 {
+        var mask: UInt8 = 0xFF
+        for k in 0 ..< fingerprintLength {
+            mask &= tables[k * 256 + Int(haystack[i + k] & 0xFF)]
+        }
+        return mask
+    }
+
+    private func literal(_ literal: [UInt16], occursIn haystack: UnsafeBufferPointer<UInt16>, at i: Int, end: Int) -> Bool {
+        guard i + literal.count <= end else { return false }
+        for (offset, unit) in literal.enumerated() where haystack[i + offset] != unit {
+            return false
+        }
+        return true
+    }
+
+    /// Calls `body` with each literal in the buckets of `mask` that begins
+    /// at `i`, stopping if it returns false.
+    private func verify(_ mask: UInt8, in haystack: UnsafeBufferPointer<UInt16>, at i: Int, end: Int, _ body: (Int) -> Bool) -> Bool {
+        for bucket in 0 ..< BucketLiteralSearcher.bucketCount where mask & UInt8(1 << bucket) != 0 {
+            for index in buckets[bucket] where literal(literals[index], occursIn: haystack, at: i, end: end) {
+                guard body(index) else { return false }
+            }
+        }
+        return true
+    }
+
+    /// Calls `body` with each literal that begins in `start ..< end`, and
+    /// where, in order of position, stopping if it returns false.
+    private func forEachOccurrence(in haystack: UnsafeBufferPointer<UInt16>, from start: Int, to end: Int, _ body: (Int, Int) -> Bool) {
+        let lastCandidate = end - fingerprintLength
+        var i = start
+        while i <= lastCandidate {
+            let mask = bucketMask(in: haystack, at: i)
+            if mask != 0 {
+                let position = i
+                guard verify(mask, in: haystack, at: position, end: end, { body(position, $0) }) else { return }
+            }
+            i += 1
+        }
+    }
+
+    /// Returns the first offset in `start ..< end` where any literal begins.
+    func firstOccurrence(in haystack: UnsafeBufferPointer<UInt16>, from start: Int, to end: Int) -> Int? {
+        var first: Int?
+        forEachOccurrence(in: haystack, from: start, to: end) { (position, _) in
+            first = position
+            return false
+        }
+        return first
+    }
+
+    /// Returns which literals occur in `haystack[start ..< end]`, by index.
+    func occurringLiterals(in haystack: UnsafeBufferPointer<UInt16>, from start: Int, to end: Int) -> [Bool] {
+        var occurs = [Bool](repeating: false, count: literals.count)
+        var remaining = literals.count
+        forEachOccurrence(in: haystack, from: start, to: end) { (_, literal) in
+            if !occurs[literal] {
+                occurs[literal] = true
+                remaining -= 1
+            }
+            return remaining > 0
+        }
+        return occurs
+    }
+
+}
@@ -0,0 +1,165 @@
+//
+//  CaseFolding.swift
+//  Irregular
+//
+
+import CUnicode
+
+/// The classes of code points ICU treats as equal when ignoring case, like
+/// `k`, `K`, and the Kelvin sign.
+///
+/// The tables are built once from ICU's case closure, so they always agree
+/// with what ICU matches, and are kept sorted for binary search with a direct
+/// table for ASCII. Closing a set over case then costs a lookup per cased
+/// code point it contains rather than a round trip through ICU.
+final class CaseFolding {
+
+    static let shared = CaseFolding()
+
+    private static let tableWidth = 128
+
+    /// The code points with case equivalents, sorted, and the class of each.
+    private var scalars = ContiguousArray<UInt32>()
+    private var scalarClasses = ContiguousArray<Int32>()
+
+    /// The members of each class: `members[starts[i] ..< starts[i + 1]]`.
+    private var members = ContiguousArray<UInt32>()
+    private var starts = ContiguousArray<Int32>()
+
+    /// The class of each ASCII code point, or -1.
+    private var asciiClasses = ContiguousArray<Int32>(repeating: -1, count: CaseFolding.tableWidth)
+
+    /// The code points in ICU's full case foldings to more than one code
+    /// point, like `ß` and the `s` of `ss`, and their equivalents. ICU
+    /// matches a case-insensitive literal with one of these against text of a
+    /// different length, so it can't be expanded into its case variants.
+    private(set) var multipleFoldings = ScalarSet()
+
+    private init() {
+        guard let candidates = ScalarSet(icuPattern: "[\\p{Cased}\\p{Changes_When_Casemapped}\\p{Changes_When_Casefolded}]") else {
+            starts.append(0)
+            return
+        }
+
+        var classOf = [UInt32: Int32]()
+        var inFoldings = [ClosedRange<UInt32>]()
+        var string = [UInt16](repeating: 0, count: 8)
+        for range in candidates.ranges {
+            for scalar in range.lowerBound ... range.upperBound where classOf[scalar] == nil {
+                let set = USet.openEmpty()
+                defer { set.pointee.close() }
+                set.pointee.addRange(Int32(scalar), Int32(scalar))
+                set.pointee.closeOver(.caseInsensitive)
+
+                // Items after the ranges are the strings of full foldings.
+                var equivalents = [UInt32]()
+                var foldings = [UInt32]()
+                var hasFoldings = false
+                for i in 0 ..< set.pointee.itemCount() {
+                    var status = UErrorCode.ZERO_ERROR
+                    var start: Int32 = 0, end: Int32 = 0
+                    let length = Int(set.pointee.item(at: i, start: &start, end: &end, string: &string, capacity: Int32(string.count), status: &status))
+                    if length == 0 {
+                        for member in UInt32(start) ... UInt32(end) {
+                            equivalents.append(member)
+                        }
+                    } else if length > 0 {
+                        hasFoldings = true
+                        guard status.isSuccess else { continue }
+                        var k = 0
+                        while k < length {
+                            if string[k] & 0xFC00 == 0xD800 && k + 1 < length {
+                                foldings.append(0x10000 + (UInt32(string[k] & 0x3FF) << 10 | UInt32(string[k + 1] & 0x3FF)))
+                                k += 2
+                            } else {
+                                foldings.append(UInt32(string[k]))
+                                k += 1
+                            }
+                        }
+                    }
+                }
+
+                if hasFoldings {
+                    inFoldings.append(contentsOf: (equivalents + foldings).map { $0 ... $0 })
+                }
+                guard equivalents.count > 1 else { continue }
+                let index = Int32(starts.count)
+                starts.append(Int32(members.count))
+                for member in equivalents {
+                    members.append(member)
+                    classOf[member] = index
+                }
+            }
+        }
+        starts.append(Int32(members.count))
+
+        for (scalar, index) in classOf.sorted(by: { $0.key < $1.key }) {
+            scalars.append(scalar)
+            scalarClasses.append(index)
+            if scalar < UInt32(CaseFolding.tableWidth) {
+                asciiClasses[Int(scalar)] = index
+            }
+        }
+        multipleFoldings = closure(of: ScalarSet(inFoldings))
+    }
+
+    private func classIndex(of scalar: UInt32) -> Int? {
+        if scalar < UInt32(CaseFolding.tableWidth) {
+            let index = asciiClasses[Int(scalar)]
+            return index < 0 ? nil : Int(index)
+        }
+        let position = firstIndex(atLeast: scalar)
+        return position < scalars.count && scalars[position] == scalar ? Int(scalarClasses[position]) : nil
+    }
+
+    /// The position of the first of `scalars` not less than `scalar`.
+    private func firstIndex(atLeast scalar: UInt32) -> Int {
+        var low = 0, high = scalars.count
+        while low < high {
+            let middle = (low + high) / 2
+            if scalars[middle] < scalar {
+                low = middle + 1
+            } else {
+                high = middle
+            }
+        }
+        return low
+    }
+
+    /// The code points equal to `scalar` when ignoring case, including
+    /// itself, or `nil` if there are no others.
+    func equivalents(of scalar: UInt32) -> ArraySlice<UInt32>? {
+        guard let index = classIndex(of: scalar) else { return nil }
+        return members[Int(starts[index]) ..< Int(starts[index + 1])]
+    }
+
+    /// Whether a case-insensitive `scalar` matches only its ASCII upper and
+    /// lowercase forms, so folding bit 5 of ASCII letters finds it.
+    func hasOnlyASCIIEquivalents(_ scalar: UInt32) -> Bool {
+        guard !multipleFoldings.contains(scalar) else { return false }
+        guard let equivalents = equivalents(of: scalar) else { return true }
+        return !equivalents.contains { $0 >= UInt32(CaseFolding.tableWidth) }
+    }
+
+    /// Returns `set` plus every code point equal to a member when ignoring
+    /// case.
+    func closure(of set: ScalarSet) -> ScalarSet {
+        var added = [ClosedRange<UInt32>]()
+        var isAdded = [Bool](repeating: false, count: starts.count)
+        for range in set.ranges {
+            var position = firstIndex(atLeast: range.lowerBound)
+            while position < scalars.count && scalars[position] <= range.upperBound {
+                let index = Int(scalarClasses[position])
+                if !isAdded[index] {
+                    isAdded[index] = true
+                    for member in members[Int(starts[index]) ..< Int(starts[index + 1])] {
+                        added.append(member ... member)
+                    }
+                }
+                position += 1
+            }
+        }
+        return added.isEmpty ? set : set.union(ScalarSet(added))
+    }
+
+}
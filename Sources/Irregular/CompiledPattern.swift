@@ -0,0 +1,127 @@
+//
+//  CompiledPattern.swift
+//  Irregular
+//
+
+/// Everything built from a pattern besides its ICU form: the parsed tree,
+/// the native engines, and the literal searches that skip ahead of them.
+///
+/// It never changes once built, so a regular expression and the copies
+/// `checkOut(options:)` makes for each ICU search share one.
+final class CompiledPattern {
+
+    let pattern: String
+    let options: RegularExpression.Options
+
+    /// The most memory, in bytes, the DFA cache may use.
+    let dfaCacheCapacity: Int
+
+    /// The most memory, in bytes, the bounded backtracker may use to track
+    /// what it has explored.
+    let backtrackingMemoryBudget: Int
+
+    /// Searches for the literal every match begins with, if there is one, so
+    /// ICU is only asked to match where it occurs.
+    let prefilter: LiteralSearcher?
+
+    /// Whether the pattern is only the `prefilter` literal, so matching never
+    /// needs ICU at all.
+    let isLiteral: Bool
+
+    /// Searches for the literals one of which every match contains, when
+    /// there's no `prefilter`, so ICU isn't given text without any.
+    let requiredLiteralSearcher: BucketLiteralSearcher?
+
+    /// The pattern as parsed, before it was optimized, or `nil` if it uses
+    /// syntax only ICU understands. This is what `serialize(_:)` stores.
+    let parsed: SyntaxTree?
+
+    /// The parsed pattern, optimized for matching with capture groups.
+    let syntax: SyntaxTree?
+
+    /// The pattern compiled for the native engines, if it can be.
+    let program: Program?
+
+    /// Whether `matches(in:)` uses the Pike VM rather than ICU: if `options`
+    /// ask for linear-time matching, or if the pattern nests unbounded
+    /// repetitions, the shape that makes ICU's backtracking take exponential
+    /// time.
+    let prefersNativeMatching: Bool
+
+    /// Lazily built DFAs for finding matches without their capture groups.
+    let dfa: DFASearcher?
+
+    /// A matcher that resolves capture groups in one pass, if the pattern
+    /// allows.
+    let onePass: OnePass?
+
+    /// A matcher that compares each character in turn, if every match is
+    /// the same sequence of characters and classes.
+    let fixedSequence: FixedSequence?
+
+    /// A bit-parallel automaton for `containsMatch(in:)`, if the pattern is
+    /// small enough.
+    let bitParallel: BitParallelNFA?
+
+    /// The engine `matches(in:)` uses, chosen from what the pattern needs.
+    let engine: RegularExpression.Engine
+
+    /// The pattern compiled to match UTF-8 directly, built when first used.
+    let utf8: LazyUTF8Searcher
+
+    /// The rewrites made to the parsed pattern for each kind of search.
+    let optimizations: [RegularExpression.Optimization]
+
+    /// Builds the native engines for `pattern` from its parsed tree, or only
+    /// the literal searches if it couldn't be parsed.
+    ///
+    /// - throws: `UNSUPPORTED_ERROR` if `options` ask for linear-time
+    ///   matching and the pattern can't be compiled for the native engines.
+    init(pattern: String, options: RegularExpression.Options, parsed: SyntaxTree?, dfaCacheCapacity: Int, backtrackingMemoryBudget: Int) throws {
+        let isICUOnly = options.contains(.icuOnly)
+        let optimized = isICUOnly ? nil : parsed.map { OptimizedSyntax($0) }
+        let syntax = optimized?.captures
+        let program = syntax.flatMap { Program($0) }
+        if options.contains(.linearTime) && program == nil {
+            throw RegularExpression.Error(pattern: pattern, code: .UNSUPPORTED_ERROR)
+        }
+
+        let literal = isICUOnly ? nil : LiteralPrefix.searcher(for: pattern, options: options)
+        let isLiteral = literal?.isWholePattern ?? false
+        let prefersNativeMatching = program != nil && (options.contains(.linearTime) || syntax?.hasNestedUnboundedRepetition == true)
+        let dfa = CompiledPattern.dfaSearcher(for: optimized?.spans, capacity: dfaCacheCapacity)
+        let onePass = program.flatMap { OnePass(program: $0) }
+        let fixedSequence = isLiteral || program == nil ? nil : syntax.flatMap { FixedSequence(syntax: $0) }
+
+        self.pattern = pattern
+        self.options = options
+        self.dfaCacheCapacity = dfaCacheCapacity
+        self.backtrackingMemoryBudget = backtrackingMemoryBudget
+        self.prefilter = literal?.searcher
+        self.isLiteral = isLiteral
+        self.requiredLiteralSearcher = literal == nil ? syntax?.requiredLiterals.flatMap { BucketLiteralSearcher(literals: $0) } : nil
+        self.parsed = parsed
+        self.syntax = syntax
+        self.program = program
+        self.prefersNativeMatching = prefersNativeMatching
+        self.dfa = dfa
+        self.onePass = onePass
+        self.fixedSequence = fixedSequence
+        self.bitParallel = optimized.flatMap { BitParallelNFA($0.existence) }
+        self.engine = RegularExpression.selectEngine(isLiteral: isLiteral, program: program, prefersNativeMatching: prefersNativeMatching, dfa: dfa, onePass: onePass, fixedSequence: fixedSequence)
+        self.utf8 = LazyUTF8Searcher(program: program, syntax: syntax, dfaCacheCapacity: dfaCacheCapacity)
+        self.optimizations = optimized?.passes ?? []
+    }
+
+    /// Builds DFAs for `syntax` and its reverse, splitting the cache
+    /// capacity between them, and a search for any literal in its middle.
+    private static func dfaSearcher(for syntax: SyntaxTree?, capacity: Int) -> DFASearcher? {
+        guard let syntax = syntax, let program = Program(syntax), LazyDFA.supports(program, direction: .forward) else { return nil }
+        let reverse = Program(syntax, reversed: true).flatMap {
+            LazyDFA.supports($0, direction: .reverse) ? DFAPool(program: $0, direction: .reverse, capacity: capacity / 2) : nil
+        }
+        let forward = DFAPool(program: program, direction: .forward, capacity: capacity / 2)
+        return DFASearcher(forward: forward, reverse: reverse, innerLiteral: InnerLiteralSearcher(syntax: syntax, forward: forward, capacity: capacity / 4))
+    }
+
+}
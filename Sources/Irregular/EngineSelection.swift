@@ -0,0 +1,333 @@
+//
+//  EngineSelection.swift
+//  Irregular
+//
+
+extension RegularExpression {
+
+    /// The ways a search can be run.
+    public enum Engine: String {
+        /// A substring search, for patterns that are only a literal.
+        case literal = "literal search"
+        /// A comparison of each character in turn, for patterns that are a
+        /// fixed sequence of characters and classes, like `\d{3}-\d{4}`.
+        case fixedSequence = "fixed sequence"
+        /// A table-driven matcher that resolves capture groups in one pass,
+        /// for patterns where only one path can continue on each character.
+        case onePass = "one-pass DFA"
+        /// Lazily built forward and reverse DFAs, which find where matches
+        /// are but not their capture groups.
+        case lazyDFA = "lazy DFA"
+        /// A bit-parallel Glushkov automaton, for small patterns.
+        case bitParallel = "bit-parallel NFA"
+        /// A backtracker that never revisits a position, for short text.
+        case boundedBacktracker = "bounded backtracker"
+        /// A Thompson NFA simulation, in time linear in the text.
+        case pikeVM = "Pike VM"
+        /// ICU's backtracking matcher, for everything else.
+        case icu = "ICU"
+    }
+
+    /// Chooses the engine `matches(in:)` uses to find matches and their
+    /// capture groups.
+    static func selectEngine(isLiteral: Bool, program: Program?, prefersNativeMatching: Bool, dfa: DFASearcher?, onePass: OnePass?, fixedSequence: FixedSequence?) -> Engine {
+        if isLiteral {
+            return .literal
+        }
+        guard let program = program else { return .icu }
+        if fixedSequence != nil {
+            return .fixedSequence
+        }
+        let hasExactSpans = dfa?.reverse != nil
+        if onePass != nil && (hasExactSpans || program.isAnchoredAtStart) {
+            return .onePass
+        } else if prefersNativeMatching {
+            return .pikeVM
+        }
+        return .icu
+    }
+
+    /// A report of how a regular expression is matched, and why, for
+    /// understanding its performance.
+    public struct Explanation: CustomStringConvertible {
+
+        public struct Rejection {
+            public let engine: Engine
+            public let reason: String
+        }
+
+        /// The engine `matches(in:)` uses to find matches and their capture
+        /// groups.
+        public let engine: Engine
+
+        /// The engine that finds where each match is before `engine` resolves
+        /// its capture groups, and that `matchRanges(in:)` uses alone.
+        public let spanEngine: Engine?
+
+        /// The engine used instead of the Pike VM or ICU on text up to
+        /// `shortTextLimit` UTF-16 code units long.
+        public let shortTextEngine: Engine?
+        public let shortTextLimit: Int?
+
+        /// The engine `containsMatch(in:)` uses.
+        public let containsMatchEngine: Engine
+
+        /// The literal every match begins with, which searches skip ahead to.
+        public let prefilterLiteral: String?
+
+        /// The literals in the middle of the pattern that unanchored searches
+        /// look for, running DFAs out from each occurrence.
+        public let innerLiterals: [String]
+
+        /// Whether the pattern ends with `\z`, `\Z` or `$`, so searches run
+        /// the reverse DFA back from the end of the text instead of scanning
+        /// forward to it.
+        public let searchesFromEnd: Bool
+
+        /// The size of the pattern compiled for the native engines.
+        public let instructionCount: Int?
+
+        public let onePassStateCount: Int?
+        public let bitParallelPositionCount: Int?
+
+        /// The number of characters in each match, for patterns matched as a
+        /// fixed sequence.
+        public let fixedSequenceLength: Int?
+
+        /// The number of states the forward DFA needs on typical text: one
+        /// for each character the pattern consumes, plus a start state.
+        /// Patterns like `(a|b)*a(a|b){20}` can need exponentially more,
+        /// which the cache capacity bounds.
+        public let estimatedDFAStateCount: Int?
+
+        /// Why each engine that isn't used wasn't chosen.
+        public let rejections: [Rejection]
+
+        /// The rewrites made to the parsed pattern, in order, with the
+        /// pattern after each.
+        public let optimizations: [Optimization]
+
+        public var description: String {
+            var lines = ["engine: \(engine.rawValue)"]
+            if let spanEngine = spanEngine {
+                lines.append("spans found by: \(spanEngine.rawValue)")
+            }
+            if let shortTextEngine = shortTextEngine, let shortTextLimit = shortTextLimit {
+                lines.append("short text: \(shortTextEngine.rawValue), up to \(shortTextLimit) UTF-16 code units")
+            }
+            lines.append("containsMatch: \(containsMatchEngine.rawValue)")
+            if let prefilterLiteral = prefilterLiteral {
+                lines.append("prefilter literal: \(String(reflecting: prefilterLiteral))")
+            }
+            if !innerLiterals.isEmpty {
+                lines.append("inner literals: \(innerLiterals.map { String(reflecting: $0) }.joined(separator: ", "))")
+            }
+            if searchesFromEnd {
+                lines.append("searches from end: reverse DFA")
+            }
+            if let instructionCount = instructionCount {
+                lines.append("instructions: \(instructionCount)")
+            }
+            if let onePassStateCount = onePassStateCount {
+                lines.append("one-pass states: \(onePassStateCount)")
+            }
+            if let bitParallelPositionCount = bitParallelPositionCount {
+                lines.append("bit-parallel positions: \(bitParallelPositionCount)")
+            }
+            if let fixedSequenceLength = fixedSequenceLength {
+                lines.append("fixed sequence length: \(fixedSequenceLength)")
+            }
+            if let estimatedDFAStateCount = estimatedDFAStateCount {
+                lines.append("estimated DFA states: \(estimatedDFAStateCount)")
+            }
+            if !rejections.isEmpty {
+                lines.append("rejected:")
+                for rejection in rejections {
+                    lines.append("  \(rejection.engine.rawValue): \(rejection.reason)")
+                }
+            }
+            if optimizations.contains(where: { $0.rewrites > 0 }) {
+                lines.append("optimizations:")
+                for optimization in optimizations where optimization.rewrites > 0 {
+                    lines.append("  \(optimization.pass.rawValue) (\(optimization.rewrites)): \(optimization.pattern)")
+                }
+            }
+            return lines.joined(separator: "\n")
+        }
+
+    }
+
+    /// Why the pattern couldn't be compiled for the native engines.
+    private var reasonForNoProgram: String {
+        if options.contains(.icuOnly) {
+            return "the options ask for ICU alone"
+        }
+        guard let syntax = syntax else {
+            return "the pattern uses syntax only ICU supports"
+        }
+
+        if syntax.features.contains(.fullCaseFolding) {
+            return "the pattern has case-insensitive literals with characters ICU folds to several, like ß, which the native engines fold one at a time"
+        } else if syntax.features.contains(.dotMatchingCRLF) {
+            return "the pattern has a . that matches line terminators, which ICU lets match a CRLF as one character"
+        }
+
+        var features = [String]()
+        if syntax.features.contains(.backreferences) { features.append("backreferences") }
+        if syntax.features.contains(.lookahead) { features.append("look-ahead") }
+        if syntax.features.contains(.lookbehind) { features.append("look-behind") }
+        if syntax.features.contains(.atomicGroups) { features.append("atomic groups") }
+        if syntax.features.contains(.previousMatchAnchor) { features.append("\\G") }
+        if syntax.features.contains(.graphemeClusters) { features.append("\\X") }
+        if syntax.features.contains(.unicodeWordBoundaries) { features.append("Unicode word boundaries") }
+        if features.isEmpty {
+            return "the pattern uses possessive quantifiers that aren't equivalent to greedy ones, or compiles to more than \(Program.maximumSize) instructions"
+        }
+        return "the pattern uses \(features.joined(separator: ", ")), which need backtracking"
+    }
+
+    /// Reports which engines are used to match this regular expression, and
+    /// why the others aren't.
+    public func explain() -> Explanation {
+        var rejections = [Explanation.Rejection]()
+        func reject(_ engine: Engine, _ reason: String) {
+            rejections.append(Explanation.Rejection(engine: engine, reason: reason))
+        }
+
+        let hasExactSpans = dfa?.reverse != nil
+        let usesOwnSpans = engine == .literal || engine == .fixedSequence
+        let spanEngine: Engine? = hasExactSpans && !usesOwnSpans ? .lazyDFA : nil
+
+        if engine != .literal {
+            reject(.literal, "the pattern isn't only a literal")
+        }
+        if engine != .fixedSequence {
+            if engine == .literal {
+                reject(.fixedSequence, "the literal search finds matches without it")
+            } else if program == nil {
+                reject(.fixedSequence, reasonForNoProgram)
+            } else {
+                reject(.fixedSequence, "matches of the pattern aren't all the same sequence of characters and classes, or are longer than \(FixedSequence.maximumLength)")
+            }
+        }
+
+        if program == nil {
+            let reason = reasonForNoProgram
+            for engine in [Engine.onePass, .lazyDFA, .boundedBacktracker, .pikeVM] {
+                reject(engine, reason)
+            }
+        } else {
+            if engine != .onePass {
+                if onePass == nil {
+                    reject(.onePass, "more than one path through the pattern can continue on the same character, or it has more than \(OnePass.maximumProgramSize) instructions")
+                } else if engine == .literal {
+                    reject(.onePass, "the literal search needs no capture groups")
+                } else if engine == .fixedSequence {
+                    reject(.onePass, "the fixed sequence resolves capture groups without it")
+                } else {
+                    reject(.onePass, "matches aren't anchored and the DFAs can't find where they start")
+                }
+            }
+
+            if dfa == nil {
+                reject(.lazyDFA, "the pattern uses assertions other than at the start or end of the text")
+            } else if !hasExactSpans {
+                reject(.lazyDFA, "the reverse DFA can't run the pattern's assertions, so the DFA only serves containsMatch")
+            } else if engine == .fixedSequence {
+                reject(.lazyDFA, "the fixed sequence finds matches without it")
+            }
+
+            if bitParallel == nil {
+                reject(.bitParallel, "the pattern has assertions or possessive quantifiers that aren't equivalent to greedy ones, or more than \(BitParallelNFA.maximumPositions) positions")
+            } else if engine == .fixedSequence {
+                reject(.bitParallel, "the fixed sequence finds matches without it")
+            }
+
+            if backtrackingMemoryBudget <= 0 {
+                reject(.boundedBacktracker, "its memory budget is 0")
+            }
+
+            if engine != .pikeVM {
+                switch engine {
+                case .onePass:
+                    reject(.pikeVM, "the one-pass DFA resolves capture groups without it")
+                case .literal:
+                    reject(.pikeVM, "the literal search finds matches without it")
+                case .fixedSequence:
+                    reject(.pikeVM, "the fixed sequence finds matches without it")
+                default:
+                    reject(.pikeVM, "the pattern doesn't nest unbounded repetitions and linear-time matching wasn't requested, so ICU is usually faster")
+                }
+            }
+        }
+        if bitParallel == nil && program == nil {
+            reject(.bitParallel, reasonForNoProgram)
+        }
+
+        if engine != .icu {
+            switch engine {
+            case .literal:
+                reject(.icu, "the literal search finds matches without it")
+            case .pikeVM where syntax?.hasNestedUnboundedRepetition == true:
+                reject(.icu, "the pattern nests unbounded repetitions, which can make ICU take exponential time")
+            case .pikeVM:
+                reject(.icu, "linear-time matching was requested")
+            default:
+                reject(.icu, "the \(engine.rawValue) resolves capture groups without backtracking")
+            }
+        }
+
+        let containsMatchEngine: Engine
+        if usesOwnSpans {
+            containsMatchEngine = engine
+        } else if bitParallel != nil {
+            containsMatchEngine = .bitParallel
+        } else if dfa != nil {
+            containsMatchEngine = .lazyDFA
+        } else {
+            containsMatchEngine = engine
+        }
+
+        var shortTextLimit: Int?
+        if let program = program, !usesOwnSpans, backtrackingMemoryBudget > 0 {
+            let limit = BoundedBacktracker.maximumLength(for: program, memoryBudget: backtrackingMemoryBudget)
+            shortTextLimit = limit > 0 ? limit : nil
+        }
+
+        var innerLiterals = [String]()
+        if let dfa = dfa, let innerLiteral = dfa.innerLiteral, dfa.usesInnerLiteral {
+            innerLiterals = innerLiteral.literals.map { String(decodingUTF16: $0) }
+        }
+
+        let estimatedDFAStateCount = dfa.map { (dfa) -> Int in
+            var consuming = 0
+            for instruction in dfa.forward.program.instructions {
+                switch instruction {
+                case .scalar, .set:
+                    consuming += 1
+                default:
+                    break
+                }
+            }
+            return consuming + 1
+        }
+
+        return Explanation(
+            engine: engine,
+            spanEngine: spanEngine,
+            shortTextEngine: shortTextLimit == nil ? nil : .boundedBacktracker,
+            shortTextLimit: shortTextLimit,
+            containsMatchEngine: containsMatchEngine,
+            prefilterLiteral: prefilter.map { String(decodingUTF16: $0.needle) },
+            innerLiterals: usesOwnSpans ? [] : innerLiterals,
+            searchesFromEnd: !usesOwnSpans && dfa?.isAnchoredAtEnd == true,
+            instructionCount: program?.instructions.count,
+            onePassStateCount: onePass?.stateCount,
+            bitParallelPositionCount: bitParallel?.positionCount,
+            fixedSequenceLength: engine == .fixedSequence ? fixedSequence?.length : nil,
+            estimatedDFAStateCount: estimatedDFAStateCount,
+            rejections: rejections,
+            optimizations: optimizations)
+    }
+
+}
@@ -0,0 +1,195 @@
+//
+//  FixedSequence.swift
+//  Irregular
+//
+
+/// A matcher for patterns that are a fixed sequence of characters, like
+/// `\d{3}-\d{4}` or `(?i)id=([0-9a-f]{8})`, as most patterns written out as
+/// literals in source are.
+///
+/// Each character of a match is compared against its position in the
+/// sequence in turn, with no program to interpret and no threads to track,
+/// and capture groups are at fixed positions. A literal the sequence begins
+/// with is searched for to find where matches can start.
+final class FixedSequence {
+
+    /// Sequences longer than this are left to the other engines, rather
+    /// than unrolling repetitions like `a{100000}`.
+    static let maximumLength = 256
+
+    private static let checkInterval = 4096
+
+    /// Marks a position that matches a set rather than one code point.
+    private static let anyScalar = UInt32.max
+
+    /// The code point each position matches, or `anyScalar`.
+    private let scalars: ContiguousArray<UInt32>
+
+    /// The code points each position matches, compiled for lookup.
+    private let sets: [ScalarSet]
+
+    /// For each capture group, the positions it starts and ends before, in
+    /// pairs, or `-1` for groups in a repetition of zero times.
+    private let capturePositions: [Int]
+
+    private let captureCount: Int
+
+    /// The literal the sequence begins with, searched for to skip ahead.
+    private let prefix: LiteralSearcher?
+
+    var length: Int {
+        return scalars.count
+    }
+
+    init?(syntax: SyntaxTree) {
+        guard syntax.features.isDisjoint(with: [.fullCaseFolding, .dotMatchingCRLF]) else { return nil }
+        var sets = [ScalarSet]()
+        var capturePositions = [Int](repeating: -1, count: 2 * syntax.captureCount)
+        guard FixedSequence.append(syntax, syntax.root, to: &sets, capturePositions: &capturePositions), !sets.isEmpty else { return nil }
+
+        var scalars = ContiguousArray<UInt32>()
+        var prefix = [UInt16]()
+        for set in sets {
+            let scalar = set.singleScalar ?? FixedSequence.anyScalar
+            let isOneUnit = scalar < 0xD800 || (scalar >= 0xE000 && scalar <= 0xFFFF)
+            if isOneUnit && prefix.count == scalars.count {
+                prefix.append(UInt16(scalar))
+            }
+            scalars.append(scalar)
+        }
+        self.scalars = scalars
+        self.sets = sets.map { $0.compiledForLookup() }
+        self.capturePositions = capturePositions
+        self.captureCount = syntax.captureCount
+        self.prefix = prefix.isEmpty ? nil : LiteralSearcher(needle: prefix, caseInsensitive: false)
+    }
+
+    /// The code points a literal matches, or `nil` if ICU may match it
+    /// against more than one character, as it does `(?i)ß` and `ss`.
+    private static func characters(of scalar: UInt32, caseInsensitive: Bool) -> ScalarSet? {
+        guard caseInsensitive else { return ScalarSet(scalar) }
+        guard !CaseFolding.shared.multipleFoldings.contains(scalar) else { return nil }
+        return ScalarSet(scalar).caseClosed()
+    }
+
+    /// Appends the code points each character of a match of `node` can be,
+    /// returning `false` if its matches don't all have the same characters
+    /// from the same sets.
+    private static func append(_ tree: SyntaxTree, _ node: SyntaxTree.NodeIndex, to sets: inout [ScalarSet], capturePositions: inout [Int]) -> Bool {
+        switch tree[node] {
+        case .empty:
+            return true
+        case let .literal(scalar, caseInsensitive):
+            guard let set = characters(of: scalar, caseInsensitive: caseInsensitive) else { return false }
+            sets.append(set)
+        case .set(let index):
+            sets.append(tree.set(at: index))
+        case let .capture(number, body):
+            capturePositions[2 * Int(number) - 2] = sets.count
+            guard append(tree, body, to: &sets, capturePositions: &capturePositions) else { return false }
+            capturePositions[2 * Int(number) - 1] = sets.count
+        case let .concatenation(start, end):
+            for child in tree.children(from: start, to: end) {
+                guard append(tree, child, to: &sets, capturePositions: &capturePositions) else { return false }
+            }
+        case let .alternation(start, end):
+            // Alternatives of one character each are one position.
+            var union = ScalarSet()
+            for branch in tree.children(from: start, to: end) {
+                switch tree[branch] {
+                case let .literal(scalar, caseInsensitive):
+                    guard let set = characters(of: scalar, caseInsensitive: caseInsensitive) else { return false }
+                    union = union.union(set)
+                case .set(let index):
+                    union = union.union(tree.set(at: index))
+                default:
+                    return false
+                }
+            }
+            sets.append(union)
+        case let .repetition(body, min, max, _):
+            // A repetition a fixed number of times is the same whichever
+            // kind it is, and its captures are those of the last time.
+            guard min == max, Int(min) <= maximumLength else { return false }
+            for _ in 0 ..< min {
+                let count = sets.count
+                guard append(tree, body, to: &sets, capturePositions: &capturePositions) else { return false }
+                // A body without characters is the same every time, and
+                // nested repetitions of it would otherwise multiply.
+                if sets.count == count {
+                    break
+                }
+            }
+        case .assertion, .lookaround, .atomic, .backreference, .graphemeCluster:
+            return false
+        }
+        return sets.count <= maximumLength
+    }
+
+    /// Returns where a match starting at `start` ends, if there is one.
+    private func matchEnd(_ input: SearchInput, at start: Int) -> Int? {
+        var i = start
+        for position in 0 ..< scalars.count {
+            guard i < input.end else { return nil }
+            let unit = input.units[i]
+            let (scalar, width) = unit & 0xF800 != 0xD800 ? (value: UInt32(unit), width: 1) : input.scalar(at: i, limit: input.end)
+            let expected = scalars[position]
+            guard scalar == expected || (expected == FixedSequence.anyScalar && sets[position].contains(scalar)) else { return nil }
+            i += width
+        }
+        return i
+    }
+
+    /// Returns the slots of a match from `start` to `end`: its bounds, then
+    /// those of each capture group, with `-1` for groups that didn't
+    /// participate.
+    private func slots(_ input: SearchInput, from start: Int, to end: Int, needsCaptures: Bool) -> ContiguousArray<Int> {
+        var slots: ContiguousArray<Int> = [start, end]
+        guard needsCaptures && captureCount > 0 else { return slots }
+
+        // Positions are code points, which may be one or two code units.
+        var offsets = ContiguousArray<Int>()
+        offsets.reserveCapacity(scalars.count + 1)
+        var i = start
+        for _ in 0 ..< scalars.count {
+            offsets.append(i)
+            i += input.scalar(at: i, limit: end).width
+        }
+        offsets.append(i)
+        for position in capturePositions {
+            slots.append(position < 0 ? -1 : offsets[position])
+        }
+        return slots
+    }
+
+    /// Returns the slots of the first match at or after `start`, or exactly
+    /// at `start` if `anchored`.
+    ///
+    /// Returns `nil` if `monitor` asks to stop or to yield, and a search
+    /// from its `suspendedIndex` carries on.
+    func match(_ input: SearchInput, from start: Int, anchored: Bool, needsCaptures: Bool, monitor: SearchMonitor?) -> ContiguousArray<Int>? {
+        if anchored {
+            return matchEnd(input, at: start).map { slots(input, from: start, to: $0, needsCaptures: needsCaptures) }
+        }
+
+        var candidate = start
+        var candidatesTried = 0
+        while candidate < input.end {
+            if let prefix = prefix {
+                guard let occurrence = prefix.firstOccurrence(in: input.units, from: candidate, to: input.end) else { return nil }
+                candidate = occurrence
+            }
+            if let end = matchEnd(input, at: candidate) {
+                return slots(input, from: candidate, to: end, needsCaptures: needsCaptures)
+            }
+            candidate += input.scalar(at: candidate, limit: input.end).width
+
+            candidatesTried += 1
+            if let monitor = monitor, candidatesTried % FixedSequence.checkInterval == 0 {
+                guard monitor.shouldContinue(steps: candidatesTried / 10_000), monitor.shouldContinueScanning(at: candidate, positions: FixedSequence.checkInterval) else { return nil }
+            }
+        }
+        return nil
+    }
+
+}
@@ -0,0 +1,83 @@
+//
+//  InnerLiteral.swift
+//  Irregular
+//
+
+/// Finds matches of patterns with a literal in the middle, like
+/// `\w+@example\.com`, by searching for the literal rather than running a
+/// DFA over all the text: from each occurrence, a reverse DFA for the part
+/// of the pattern before the literal finds where a match would start, and
+/// the forward DFA from there confirms where it ends.
+///
+/// The part before the literal can't consume the literal's first code
+/// point, so every match that starts at or before an occurrence has its
+/// literal there. The reverse DFA's longest match is then the leftmost
+/// start, and if the forward DFA finds no match from it, there is none
+/// from any start up to the occurrence.
+final class InnerLiteralSearcher {
+
+    private enum Literals {
+        case one(LiteralSearcher)
+        case several(BucketLiteralSearcher)
+    }
+
+    /// The literals searched for, in UTF-16.
+    let literals: [[UInt16]]
+
+    private let searcher: Literals
+    private let prefix: DFAPool
+    private let forward: DFAPool
+
+    init?(syntax: SyntaxTree, forward: DFAPool, capacity: Int) {
+        guard let inner = syntax.innerLiterals, let program = Program(inner.prefix, reversed: true), LazyDFA.supports(program, direction: .reverse) else { return nil }
+        if inner.literals.count == 1 {
+            self.searcher = .one(LiteralSearcher(needle: inner.literals[0], caseInsensitive: false))
+        } else if let buckets = BucketLiteralSearcher(literals: inner.literals) {
+            self.searcher = .several(buckets)
+        } else {
+            return nil
+        }
+        self.literals = inner.literals
+        self.prefix = DFAPool(program: program, direction: .reverse, capacity: capacity)
+        self.forward = forward
+    }
+
+    private func firstOccurrence(in input: SearchInput, from start: Int) -> Int? {
+        switch searcher {
+        case .one(let searcher):
+            return searcher.firstOccurrence(in: input.units, from: start, to: input.end)
+        case .several(let searcher):
+            return searcher.firstOccurrence(in: input.units, from: start, to: input.end)
+        }
+    }
+
+    /// Returns the UTF-16 offsets of the first match at or after `start`.
+    func span(in input: SearchInput, from start: Int, monitor: SearchMonitor?) -> DFASearcher.Span {
+        var from = start
+        while let occurrence = firstOccurrence(in: input, from: from) {
+            let matchStart: Int
+            switch prefix.withDFA({ $0.find(input.bounded(from: from, to: occurrence), from: occurrence, anchored: true, earliest: false, monitor: monitor) }) {
+            case .match(let offset):
+                matchStart = offset
+            case .noMatch:
+                guard monitor?.interruption == nil else { return .none }
+                from = occurrence + 1
+                continue
+            case .gaveUp:
+                return .gaveUp
+            }
+
+            switch forward.withDFA({ $0.find(input, from: matchStart, anchored: true, earliest: false, monitor: monitor) }) {
+            case .match(let end):
+                return .found(matchStart ..< end)
+            case .noMatch:
+                guard monitor?.interruption == nil else { return .none }
+                from = occurrence + 1
+            case .gaveUp:
+                return .gaveUp
+            }
+        }
+        return .none
+    }
+
+}
@@ -18,32 +18,117 @@ private extension URegularExpression {
         setTextString(&unusedBuffer, length: 0, status: &unusedError)
         setUsesTransparentBounds(0, status: &unusedError)
         setUsesAnchoringBounds(1, status: &unusedError)
+        setMatchCallback(nil, context: nil, status: &unusedError)
+        setFindProgressCallback(nil, context: nil, status: &unusedError)
     }
     
 }
 
+extension URegularExpression.Options {
+
+    /// Match with the native Pike VM, which takes time linear in the length
+    /// of the text for any pattern. Creating a regular expression with this
+    /// option fails for patterns that need backtracking: backreferences,
+    /// look-around, atomic groups, and possessive quantifiers.
+    public static let linearTime = URegularExpression.Options(rawValue: 1 << 16)
+
+    /// Match with ICU alone, without parsing the pattern or searching for its
+    /// literals, so tests can compare the native engines with it.
+    static let icuOnly = URegularExpression.Options(rawValue: 1 << 17)
+
+    /// Options handled by this library rather than ICU.
+    static let engineSelection: URegularExpression.Options = [.linearTime, .icuOnly]
+
+}
+
+/// An ICU pattern, which may be opened only when first needed: opening it is
+/// the costliest part of creating a regular expression, and one loaded with
+/// `init(serialized:)` that only the native engines match never has to.
+final class ICUHandle {
+
+    private let pattern: String
+    private let options: URegularExpression.Options
+    private let semaphore = DispatchSemaphore(value: 1)
+    private var handle: UnsafeMutablePointer<URegularExpression>?
+
+    init(_ handle: UnsafeMutablePointer<URegularExpression>) {
+        self.pattern = ""
+        self.options = []
+        self.handle = handle
+    }
+
+    init(pattern: String, options: URegularExpression.Options) {
+        self.pattern = pattern
+        self.options = options
+    }
+
+    deinit {
+        handle?.pointee.close()
+    }
+
+    /// The pattern, which `open()` must have opened.
+    var opened: UnsafeMutablePointer<URegularExpression> {
+        guard let handle = handle else { preconditionFailure("the ICU pattern hasn't been opened") }
+        return handle
+    }
+
+    /// Opens the pattern, if it isn't already.
+    func open() throws {
+        semaphore.wait()
+        defer { semaphore.signal() }
+        guard handle == nil else { return }
+
+        var parseError = UParseError()
+        var status = UErrorCode.ZERO_ERROR
+        handle = pattern.withUText { URegularExpression.open(pattern: $0, options: options, errorDetails: &parseError, status: &status) }
+        if handle == nil {
+            throw RegularExpression.Error(pattern: pattern, code: status, line: parseError.line, offset: parseError.offset)
+        }
+    }
+
+}
+
 public final class RegularExpression {
 
     public typealias Options = URegularExpression.Options
 
     public struct Error: Swift.Error {
+
+        /// Why a search over valid input was abandoned before it finished.
+        public enum Interruption {
+            case deadlineExceeded
+            case stepLimitExceeded
+            case cancelled
+        }
+
         let pattern: String
         let code: Int
         let line: Int?
         let offset: Int?
+        public let interruption: Interruption?
 
-        fileprivate init(pattern: String, code: UErrorCode, line: Int32, offset: Int32) {
+        init(pattern: String, code: UErrorCode, line: Int32, offset: Int32) {
             self.pattern = pattern
             self.code = Int(code.rawValue)
             self.line = line <= 0 ? nil : Int(line)
             self.offset = offset < 0 ? nil : Int(offset)
+            self.interruption = nil
         }
 
-        fileprivate init(pattern: String, code: UErrorCode) {
+        init(pattern: String, code: UErrorCode) {
             self.pattern = pattern
             self.code = Int(code.rawValue)
             self.line = nil
             self.offset = nil
+            self.interruption = nil
+        }
+
+        init(pattern: String, interruption: Interruption) {
+            self.pattern = pattern
+            self.code = Int(interruption == .deadlineExceeded ? UErrorCode.REGEX_TIME_OUT.rawValue : UErrorCode.REGEX_STOPPED_BY_CALLER.rawValue)
+            self.line = nil
+            self.offset = nil
+            self.interruption = interruption
         }
     }
 
@@ -57,57 +142,111 @@ public final class RegularExpression {
         }
     }
 
-    private let pattern: String
-    private let handle: UnsafeMutablePointer<URegularExpression>
+    /// The parsed pattern and native engines, shared with the copies made
+    /// for ICU searches.
+    let compiled: CompiledPattern
+    private let icu: ICUHandle
     private let reused: ReuseState
 
-    public init(pattern: String, options: Options = []) throws {
+    /// The ICU pattern, for regular expressions from `checkOut(options:)`,
+    /// which opens it.
+    var handle: UnsafeMutablePointer<URegularExpression> {
+        return icu.opened
+    }
+
+    // The compiled state, by the names the searches below use.
+    var pattern: String { return compiled.pattern }
+    var options: Options { return compiled.options }
+    var dfaCacheCapacity: Int { return compiled.dfaCacheCapacity }
+    var backtrackingMemoryBudget: Int { return compiled.backtrackingMemoryBudget }
+    var prefilter: LiteralSearcher? { return compiled.prefilter }
+    var isLiteral: Bool { return compiled.isLiteral }
+    var requiredLiteralSearcher: BucketLiteralSearcher? { return compiled.requiredLiteralSearcher }
+    var parsed: SyntaxTree? { return compiled.parsed }
+    var syntax: SyntaxTree? { return compiled.syntax }
+    var program: Program? { return compiled.program }
+    var prefersNativeMatching: Bool { return compiled.prefersNativeMatching }
+    var dfa: DFASearcher? { return compiled.dfa }
+    var onePass: OnePass? { return compiled.onePass }
+    var fixedSequence: FixedSequence? { return compiled.fixedSequence }
+    var bitParallel: BitParallelNFA? { return compiled.bitParallel }
+    var engine: Engine { return compiled.engine }
+    var utf8: LazyUTF8Searcher { return compiled.utf8 }
+    var optimizations: [Optimization] { return compiled.optimizations }
+
+    /// The default for the most memory each regular expression's DFA cache
+    /// may use, in bytes.
+    public static let defaultDFACacheCapacity = 2 << 20
+
+    /// The default for the most memory a search with the bounded backtracker
+    /// may use, in bytes.
+    public static let defaultBacktrackingMemoryBudget = 256 << 10
+
+    /// Creates a regular expression.
+    ///
+    /// - parameter dfaCacheCapacity: The most memory, in bytes, the cache of
+    ///   lazily built DFA states may use. When it fills up it is cleared, and
+    ///   a search that clears it too often falls back to the Pike VM.
+    /// - parameter backtrackingMemoryBudget: The most memory, in bytes, a
+    ///   search with the native bounded backtracker may use. It needs a bit
+    ///   for each instruction of the compiled pattern at each position of the
+    ///   text, and half as much again to tell searches apart, and text short
+    ///   enough to fit is matched with it rather than ICU. Pass 0 to never
+    ///   use it.
+    public init(pattern: String, options: Options = [], dfaCacheCapacity: Int = RegularExpression.defaultDFACacheCapacity, backtrackingMemoryBudget: Int = RegularExpression.defaultBacktrackingMemoryBudget) throws {
         var parseError = UParseError()
         var status = UErrorCode.ZERO_ERROR
-        if let handle = pattern.withUText({ URegularExpression.open(pattern: $0, options: options, errorDetails: &parseError, status: &status) }) {
-            self.pattern = pattern
-            self.handle = handle
-            self.reused = .new
-        } else {
+        let icuOptions = options.subtracting(.engineSelection)
+        guard let handle = pattern.withUText({ URegularExpression.open(pattern: $0, options: icuOptions, errorDetails: &parseError, status: &status) }) else {
             throw Error(pattern: pattern, code: status, line: parseError.line, offset: parseError.offset)
         }
+        // Closes the handle if compiling throws.
+        let icu = ICUHandle(handle)
+        self.compiled = try CompiledPattern(pattern: pattern, options: options, parsed: try? Parser.parse(pattern, options: options), dfaCacheCapacity: dfaCacheCapacity, backtrackingMemoryBudget: backtrackingMemoryBudget)
+        self.icu = icu
+        self.reused = .new
     }
 
     fileprivate init(pattern: StaticString) throws {
         var parseError = UParseError()
         var status = UErrorCode.ZERO_ERROR
-
-        if let handle = pattern.withUTF8Buffer({ URegularExpression.open(cString: $0.baseAddress, options: [], errorDetails: &parseError, status: &status) }) {
-            self.pattern = "\(pattern)"
-            self.handle = handle
-            self.reused = .new
-        } else {
+        guard let handle = pattern.withUTF8Buffer({ URegularExpression.open(cString: $0.baseAddress, options: [], errorDetails: &parseError, status: &status) }) else {
             throw Error(pattern: "\(pattern)", code: status, line: parseError.line, offset: parseError.offset)
         }
+        let icu = ICUHandle(handle)
+        let string = "\(pattern)"
+        self.compiled = try CompiledPattern(pattern: string, options: [], parsed: try? Parser.parse(string, options: []), dfaCacheCapacity: RegularExpression.defaultDFACacheCapacity, backtrackingMemoryBudget: RegularExpression.defaultBacktrackingMemoryBudget)
+        self.icu = icu
+        self.reused = .new
+    }
+
+    /// Creates a regular expression from a pattern parsed before, leaving
+    /// ICU to open it when a search first needs it.
+    init(pattern: String, options: Options, parsed syntax: SyntaxTree?, dfaCacheCapacity: Int, backtrackingMemoryBudget: Int) throws {
+        self.compiled = try CompiledPattern(pattern: pattern, options: options, parsed: syntax, dfaCacheCapacity: dfaCacheCapacity, backtrackingMemoryBudget: backtrackingMemoryBudget)
+        self.icu = ICUHandle(pattern: pattern, options: options.subtracting(.engineSelection))
+        self.reused = .new
     }
 
     private init(checkingOut original: RegularExpression, options: MatchingOptions, semaphore: DispatchSemaphore) {
-        self.pattern = original.pattern
-        self.handle = original.handle
+        self.compiled = original.compiled
+        self.icu = original.icu
         self.reused = .checkedOut(options, semaphore)
     }
 
     private init(cloning original: RegularExpression) throws {
         var status = UErrorCode.ZERO_ERROR
-        if let handle = original.handle.pointee.clone(status: &status) {
-            self.pattern = original.pattern
-            self.handle = handle
-            self.reused = .cloned
-        } else {
+        guard let handle = original.handle.pointee.clone(status: &status) else {
             throw Error(pattern: original.pattern, code: status)
         }
+        self.compiled = original.compiled
+        self.icu = ICUHandle(handle)
+        self.reused = .cloned
     }
 
     deinit {
-        switch reused {
-        case .checkedIn, .cloned:
-            handle.pointee.close()
-        case let .checkedOut(options, sema):
+        // The ICU pattern is closed with the last regular expression using it.
+        if case let .checkedOut(options, sema) = reused {
             handle.pointee.resetText(options: options)
             sema.signal()
         }
@@ -124,7 +263,8 @@ public final class RegularExpression {
         public static let withoutAnchoringBounds = MatchingOptions(rawValue: 1 << 2)
     }
 
-    private func checkOut(options: MatchingOptions) throws -> RegularExpression {
+    func checkOut(options: MatchingOptions) throws -> RegularExpression {
+        try icu.open()
         if case .checkedIn(let sema) = reused, case .success = sema.wait(timeout: .now()) {
             return RegularExpression(checkingOut: self, options: options, semaphore: sema)
         } else {
@@ -132,68 +272,353 @@ public final class RegularExpression {
         }
     }
 
-    public func matches(in string: String, options: MatchingOptions = [], range: Range<String.Index>? = nil) throws -> Matches {
+    public func matches(in string: String, options: MatchingOptions = [], range: Range<String.Index>? = nil, limits: MatchLimits = MatchLimits()) throws -> Matches {
+        return try matches(in: string, options: options, range: range, monitor: limits.isUnlimited ? nil : SearchMonitor(limits: limits))
+    }
+
+    static func utf16Bounds(of range: Range<String.Index>?, in string: String) -> (Int, Int) {
+        guard let range = range else { return (0, string.utf16.count) }
+        let start = string.utf16.distance(from: string.utf16.startIndex, to: range.lowerBound.samePosition(in: string.utf16))
+        let end = string.utf16.distance(from: string.utf16.startIndex, to: range.upperBound.samePosition(in: string.utf16))
+        return (start, end)
+    }
+
+    func matches(in string: String, options: MatchingOptions, range: Range<String.Index>?, monitor: SearchMonitor?, needsCaptures: Bool = true) throws -> Matches {
+        let (regionStart, regionLimit) = RegularExpression.utf16Bounds(of: range, in: string)
+        if let prefilter = prefilter, engine == .literal {
+            let scan = LiteralScan(searcher: prefilter, units: ContiguousArray(string.utf16), start: regionStart, end: regionLimit, anchored: options.contains(.anchored))
+            return Matches(base: self, source: string, options: options, monitor: monitor, engine: .literal(scan))
+        }
+
+        // Even when ICU was chosen, the native engines are used when DFAs can
+        // find exact spans and no capture groups are needed, when the pattern
+        // is anchored at the end so the reverse DFA finds the span without
+        // reading the text before it, or when the text is short enough to
+        // backtrack over without risk.
+        var usesNativeEngines = engine != .icu
+        if let program = program, !usesNativeEngines {
+            let hasExactSpans = dfa?.reverse != nil
+            usesNativeEngines = (hasExactSpans && (!needsCaptures || dfa?.isAnchoredAtEnd == true)) || BoundedBacktracker.fits(program, length: regionLimit - regionStart, memoryBudget: backtrackingMemoryBudget)
+        }
+        if let program = program, usesNativeEngines {
+            let scan = NativeScan(program: program, searcher: dfa, onePass: onePass, fixedSequence: fixedSequence, backtrackingMemoryBudget: backtrackingMemoryBudget, needsCaptures: needsCaptures, units: ContiguousArray(string.utf16), start: regionStart, end: regionLimit, options: options)
+            return Matches(base: self, source: string, options: options, monitor: monitor, engine: .native(scan))
+        }
+
+        // The native engines skip ahead with their own DFA and literal
+        // searches, so the required literals are only looked for before
+        // handing the text to ICU.
+        if let searcher = requiredLiteralSearcher {
+            let hasRequiredLiteral = ContiguousArray(string.utf16).withUnsafeBufferPointer { searcher.firstOccurrence(in: $0, from: regionStart, to: regionLimit) != nil }
+            if !hasRequiredLiteral {
+                return Matches(base: self, source: string, options: options, monitor: monitor, engine: .empty)
+            }
+        }
+
         var status = UErrorCode.ZERO_ERROR
         return try string.withUText { (text) -> Matches in
             let regex = try checkOut(options: options)
+            monitor?.install(on: regex.handle)
             regex.handle.pointee.setText(text, status: &status)
             regex.handle.pointee.setUsesTransparentBounds(options.contains(.withTransparentBounds) ? 1 : 0, status: &status)
             regex.handle.pointee.setUsesAnchoringBounds(options.contains(.withoutAnchoringBounds) ? 0 : 1, status: &status)
 
-            if let range = range {
-                let start = range.lowerBound.samePosition(in: string.utf16)
-                let end = range.upperBound.samePosition(in: string.utf16)
-                let regionStart: Int64 = numericCast(string.utf16.distance(from: string.utf16.startIndex, to: start))
-                let regionLimit: Int64 = numericCast(string.utf16.distance(from: string.utf16.startIndex, to: end))
-
-                regex.handle.pointee.setRegion(start: regionStart, end: regionLimit, status: &status)
+            if range != nil {
+                regex.handle.pointee.setRegion(start: numericCast(regionStart), end: numericCast(regionLimit), status: &status)
             }
 
             guard status.isSuccess else {
                 throw Error(pattern: pattern, code: status)
             }
 
-            return Matches(base: regex, source: string, options: options)
+            if let prefilter = prefilter, !options.contains(.anchored) {
+                let scan = PrefilterScan(searcher: prefilter, units: ContiguousArray(string.utf16), start: regionStart, end: regionLimit)
+                return Matches(base: regex, source: string, options: options, monitor: monitor, engine: .prefiltered(scan))
+            }
+
+            return Matches(base: regex, source: string, options: options, monitor: monitor, engine: .icu)
         }
     }
 
+    /// Returns whether `string` contains a match, without finding where it
+    /// is or what its capture groups are.
+    ///
+    /// Patterns of a fixed sequence of characters are matched directly.
+    /// Otherwise this searches for a literal in the middle of the pattern if
+    /// it has one, and otherwise uses a bit-parallel automaton for small
+    /// patterns, or else a lazily built DFA when the pattern allows, which
+    /// are much faster than finding the match.
+    public func containsMatch(in string: String, options: MatchingOptions = [], range: Range<String.Index>? = nil, limits: MatchLimits = MatchLimits()) throws -> Bool {
+        let monitor = limits.isUnlimited ? nil : SearchMonitor(limits: limits)
+        if let fixedSequence = fixedSequence {
+            let (regionStart, regionLimit) = RegularExpression.utf16Bounds(of: range, in: string)
+            monitor?.beginSearch()
+            let found = ContiguousArray(string.utf16).withUnsafeBufferPointer { (buffer) -> Bool in
+                let input = SearchInput(units: buffer, start: regionStart, end: regionLimit, options: options)
+                return fixedSequence.match(input, from: regionStart, anchored: options.contains(.anchored), needsCaptures: false, monitor: monitor) != nil
+            }
+            if let interruption = monitor?.interruption {
+                throw Error(pattern: pattern, interruption: interruption)
+            }
+            return found
+        }
+
+        if let dfa = dfa, let innerLiteral = dfa.innerLiteral, dfa.usesInnerLiteral, !isLiteral, !options.contains(.anchored) {
+            let (regionStart, regionLimit) = RegularExpression.utf16Bounds(of: range, in: string)
+            monitor?.beginSearch()
+            let span = ContiguousArray(string.utf16).withUnsafeBufferPointer { (buffer) -> DFASearcher.Span in
+                let input = SearchInput(units: buffer, start: regionStart, end: regionLimit, options: options)
+                return innerLiteral.span(in: input, from: regionStart, monitor: monitor)
+            }
+            if let interruption = monitor?.interruption {
+                throw Error(pattern: pattern, interruption: interruption)
+            }
+            switch span {
+            case .found:
+                return true
+            case .none:
+                return false
+            case .gaveUp:
+                break
+            }
+        }
+
+        if let bitParallel = bitParallel, !isLiteral {
+            let (regionStart, regionLimit) = RegularExpression.utf16Bounds(of: range, in: string)
+            monitor?.beginSearch()
+            let found = ContiguousArray(string.utf16).withUnsafeBufferPointer { (buffer) -> Bool in
+                let input = SearchInput(units: buffer, start: regionStart, end: regionLimit, options: options)
+                return bitParallel.containsMatch(in: input, from: regionStart, anchored: options.contains(.anchored), monitor: monitor)
+            }
+            if let interruption = monitor?.interruption {
+                throw Error(pattern: pattern, interruption: interruption)
+            }
+            return found
+        }
+
+        if let dfa = dfa, !isLiteral {
+            let units = ContiguousArray(string.utf16)
+            let (regionStart, regionLimit) = RegularExpression.utf16Bounds(of: range, in: string)
+            monitor?.beginSearch()
+            let result = units.withUnsafeBufferPointer { (buffer) -> LazyDFA.Result in
+                let input = SearchInput(units: buffer, start: regionStart, end: regionLimit, options: options)
+                return dfa.containsMatch(in: input, from: regionStart, anchored: options.contains(.anchored), monitor: monitor)
+            }
+            if let interruption = monitor?.interruption {
+                throw Error(pattern: pattern, interruption: interruption)
+            }
+
+            switch result {
+            case .match:
+                return true
+            case .noMatch:
+                return false
+            case .gaveUp:
+                let scan = NativeScan(program: dfa.forward.program, searcher: nil, needsCaptures: false, units: units, start: regionStart, end: regionLimit, options: options)
+                let found = scan.findNext(monitor: monitor) != nil
+                if let interruption = monitor?.interruption {
+                    throw Error(pattern: pattern, interruption: interruption)
+                }
+                return found
+            }
+        }
+
+        var matches = try self.matches(in: string, options: options, range: range, monitor: monitor, needsCaptures: false)
+        return try matches.nextMatch() != nil
+    }
+
+    /// Returns the ranges of the matches in `string`, without their capture
+    /// groups.
+    ///
+    /// When the pattern allows, each range is found by a forward DFA, which
+    /// finds where the match ends, and a reverse DFA run back from there,
+    /// which finds where it starts.
+    public func matchRanges(in string: String, options: MatchingOptions = [], range: Range<String.Index>? = nil, limits: MatchLimits = MatchLimits()) throws -> MatchRanges {
+        let monitor = limits.isUnlimited ? nil : SearchMonitor(limits: limits)
+        return MatchRanges(matches: try matches(in: string, options: options, range: range, monitor: monitor, needsCaptures: false))
+    }
+
+    /// Returns the range of the first match in `string`, without its capture
+    /// groups.
+    public func firstMatchRange(in string: String, options: MatchingOptions = [], range: Range<String.Index>? = nil, limits: MatchLimits = MatchLimits()) throws -> Range<String.Index>? {
+        var ranges = try matchRanges(in: string, options: options, range: range, limits: limits)
+        return try ranges.nextRange()
+    }
+
+    public struct MatchRanges: IteratorProtocol, Sequence {
+
+        private var matches: Matches
+
+        fileprivate init(matches: Matches) {
+            self.matches = matches
+        }
+
+        public mutating func next() -> Range<String.Index>? {
+            return (try? nextRange()) ?? nil
+        }
+
+        /// Returns the next range, or `nil` if there are no more.
+        ///
+        /// Unlike `next()`, this surfaces a search abandoned for exceeding its
+        /// `MatchLimits`.
+        public mutating func nextRange() throws -> Range<String.Index>? {
+            guard let match = try matches.nextMatch() else { return nil }
+            return match.range
+        }
+
+    }
+
     public struct Matches: IteratorProtocol, Sequence {
 
         private let base: RegularExpression
         private let source: String
         private let options: MatchingOptions
+        private let monitor: SearchMonitor?
+        private let engine: Engine
+
+        /// Set after an anchored ICU match, which `lookingAt` would find
+        /// again every time; like the native engines, an anchored search
+        /// matches at most once.
+        private var isFinished = false
+
+        /// How matches are found.
+        fileprivate enum Engine {
+            /// ICU's `findNext`, or `lookingAt` if anchored.
+            case icu
+            /// ICU's `lookingAt`, only where the literal prefix occurs.
+            case prefiltered(PrefilterScan)
+            /// A substring search, without ICU.
+            case literal(LiteralScan)
+            /// The Pike VM, without ICU.
+            case native(NativeScan)
+            /// Nothing, because a literal every match contains doesn't occur.
+            case empty
+        }
 
-        fileprivate init(base: RegularExpression, source: String, options: MatchingOptions) {
+        fileprivate init(base: RegularExpression, source: String, options: MatchingOptions, monitor: SearchMonitor?, engine: Engine) {
             self.base = base
             self.source = source
             self.options = options
+            self.monitor = monitor
+            self.engine = engine
+        }
+
+        private func range(fromUTF16Offset startOffset: Int, to endOffset: Int) -> Range<String.Index> {
+            guard startOffset >= 0, endOffset >= startOffset,
+                let start = source.utf16.index(source.utf16.startIndex, offsetBy: startOffset).samePosition(in: source),
+                let end = source.utf16.index(source.utf16.startIndex, offsetBy: endOffset).samePosition(in: source) else {
+                return source.endIndex ..< source.endIndex
+            }
+            return start ..< end
         }
 
         fileprivate var numberOfCaptureGroups: Int {
             var errorCode = UErrorCode.ZERO_ERROR
             let ret = base.handle.pointee.numberOfCaptureGroups(status: &errorCode)
-            guard errorCode.isSuccess else { return 1 }
+            guard errorCode.isSuccess else { return 0 }
             return Int(ret)
         }
 
         public mutating func next() -> MatchGroup? {
+            return (try? nextMatch()) ?? nil
+        }
+
+        /// Returns the next match, or `nil` if there are no more.
+        ///
+        /// Unlike `next()`, this surfaces a search abandoned for exceeding its
+        /// `MatchLimits`.
+        public mutating func nextMatch() throws -> MatchGroup? {
+            while true {
+                switch try step() {
+                case .match(let group):
+                    return group
+                case .suspended:
+                    continue
+                case .finished:
+                    return nil
+                }
+            }
+        }
+
+        enum Step {
+            case match(MatchGroup)
+            case suspended
+            case finished
+        }
+
+        /// Runs one search, which may return early if the monitor asked ICU or
+        /// a native search to stop so the caller can yield; the next step
+        /// resumes where it left off.
+        mutating func step() throws -> Step {
+            if case .empty = engine {
+                return .finished
+            } else if isFinished {
+                return .finished
+            }
+
+            if case .literal(let scan) = engine {
+                monitor?.beginSearch()
+                let offsets = scan.findNext(monitor: monitor)
+                if let interruption = monitor?.interruption {
+                    throw Error(pattern: base.pattern, interruption: interruption)
+                } else if monitor?.suspendedIndex != nil {
+                    return .suspended
+                }
+                guard let found = offsets else { return .finished }
+                return .match(MatchGroup(ranges: [range(fromUTF16Offset: found.lowerBound, to: found.upperBound)], within: source))
+            }
+
+            if case .native(let scan) = engine {
+                monitor?.beginSearch()
+                let slots = scan.findNext(monitor: monitor)
+                if let interruption = monitor?.interruption {
+                    throw Error(pattern: base.pattern, interruption: interruption)
+                } else if monitor?.suspendedIndex != nil {
+                    return .suspended
+                }
+                guard let found = slots else { return .finished }
+                return .match(MatchGroup(ranges: stride(from: 0, to: found.count, by: 2).map({ (i) in
+                    range(fromUTF16Offset: found[i], to: found[i + 1])
+                }), within: source))
+            }
+
             var errorCode = UErrorCode.ZERO_ERROR
-            guard (options.contains(.anchored) && base.handle.pointee.isLooking(atIndex: -1, status: &errorCode) != 0) ||
-                (!options.contains(.anchored) && base.handle.pointee.findNext(status: &errorCode) != 0),
-                errorCode.isSuccess else {
-                return nil
+            if let monitor = monitor, let resumeIndex = monitor.suspendedIndex {
+                let regionStart = base.handle.pointee.regionStart(status: &errorCode)
+                let regionEnd = base.handle.pointee.regionEnd(status: &errorCode)
+                base.handle.pointee.setRegion(start: regionStart, end: regionEnd, startIndex: resumeIndex, status: &errorCode)
+            }
+
+            monitor?.beginSearch()
+            let found: Bool
+            if case .prefiltered(let scan) = engine {
+                found = scan.findNext(with: base.handle, monitor: monitor, status: &errorCode)
+            } else {
+                found = (options.contains(.anchored) && base.handle.pointee.isLooking(atIndex: -1, status: &errorCode) != 0) ||
+                    (!options.contains(.anchored) && base.handle.pointee.findNext(status: &errorCode) != 0)
+            }
+
+            if let interruption = monitor?.interruption {
+                throw Error(pattern: base.pattern, interruption: interruption)
+            } else if monitor?.suspendedIndex != nil {
+                return .suspended
+            }
+
+            guard found, errorCode.isSuccess else {
+                return .finished
+            }
+            if options.contains(.anchored) {
+                isFinished = true
             }
 
-            return MatchGroup(ranges: (0 ..< numberOfCaptureGroups).map({ (i) in
+            return .match(MatchGroup(ranges: (0 ... numberOfCaptureGroups).map({ (i) in
                 let startOffset = base.handle.pointee.startIndex(forGroupAtIndex: Int32(i), status: &errorCode)
                 let endOffset = base.handle.pointee.endIndex(forGroupAtIndex: Int32(i), status: &errorCode)
-                guard errorCode.isSuccess, startOffset >= 0, endOffset >= startOffset,
-                    let start = source.utf16.index(source.utf16.startIndex, offsetBy: Int(startOffset)).samePosition(in: source),
-                    let end = source.utf16.index(source.utf16.startIndex, offsetBy: Int(endOffset)).samePosition(in: source) else {
+                guard errorCode.isSuccess else {
                     return source.endIndex ..< source.endIndex
                 }
-                return start ..< end
-            }), within: source)
+                return range(fromUTF16Offset: Int(startOffset), to: Int(endOffset))
+            }), within: source))
         }
 
     }
@@ -205,7 +630,7 @@ public final class RegularExpression {
         private let matchAndCaptures: [Range<String.Index>]
         fileprivate let source: String
 
-        fileprivate init(ranges: [Range<String.Index>], within source: String) {
+        init(ranges: [Range<String.Index>], within source: String) {
             self.matchAndCaptures = ranges
             self.source = source
         }
@@ -219,7 +644,7 @@ public final class RegularExpression {
         }
 
         public var endIndex: Int {
-            return ranges.count
+            return matchAndCaptures.count
         }
 
         public subscript(i: Int) -> String {
@@ -0,0 +1,570 @@
+//
+//  LazyDFA.swift
+//  Irregular
+//
+
+import Dispatch
+
+/// A DFA over a `Program`, determinized one transition at a time as the text
+/// needs it and kept in a cache of bounded size.
+///
+/// A state is the priority-ordered list of threads the Pike VM would have at
+/// a position, minus their captures, so the DFA only finds where matches
+/// end. Run forward, threads after one that matches are cut off like in the
+/// Pike VM, so a leftmost-first search reports the same end ICU would. Run
+/// backward over a reversed program from the end of a match, nothing is cut
+/// and the last match seen is where the match starts.
+///
+/// The DFA supports assertions that only depend on where the search starts,
+/// like `\A` run forward, and assertions that lead straight to a match, like
+/// a trailing `\z`, `\Z`, or `$` without `anchorsMatchLines`. Other
+/// assertions need the text around each position and are left to the Pike
+/// VM.
+///
+/// Transitions are kept per class of code points the program doesn't tell
+/// apart, so a state's row is a few entries rather than one per code point,
+/// and state IDs are premultiplied by the row length so following a
+/// transition is one add and one load.
+final class LazyDFA {
+
+    enum Direction {
+        case forward
+        case reverse
+    }
+
+    enum Result {
+        /// The end of the match, or its start if searching in reverse, as a
+        /// UTF-16 offset.
+        case match(Int)
+        case noMatch
+        /// The cache was cleared too often to make progress.
+        case gaveUp
+    }
+
+    private struct StateKey: Hashable {
+        /// The threads, in priority order: instructions that consume input,
+        /// and assertions waiting on the position that lead only to a match.
+        var threads: [Int32] = []
+        /// Whether a thread matched.
+        var isMatch = false
+        /// Whether a new thread starts at every position, for unanchored
+        /// searches that haven't matched yet.
+        var isSeeding = false
+
+        var hashValue: Int {
+            var hash = (isMatch ? 1 : 0) | (isSeeding ? 2 : 0)
+            for pc in threads {
+                hash = (hash &* 31) &+ Int(pc)
+            }
+            return hash
+        }
+
+        static func == (lhs: StateKey, rhs: StateKey) -> Bool {
+            return lhs.isMatch == rhs.isMatch && lhs.isSeeding == rhs.isSeeding && lhs.threads == rhs.threads
+        }
+    }
+
+    private static let unknown: Int32 = -1
+
+    /// After this many cache clears in one search, the search gives up if it
+    /// is adding states faster than it consumes input.
+    private static let tolerableClears = 3
+    private static let minimumUnitsPerState = 10
+
+    /// The monitor is consulted once per this many positions.
+    private static let checkInterval = 4096
+
+    /// The bit for an assertion whose value is known where a search starts,
+    /// and never holds after the search consumes input.
+    private static func initialBit(for assertion: SyntaxTree.Assertion, direction: Direction) -> UInt8? {
+        switch (direction, assertion) {
+        case (.forward, .startOfText):
+            return 1
+        case (.reverse, .endOfText):
+            return 1
+        case (.reverse, .endOfTextOrBeforeFinalTerminator(let unixLines)):
+            return unixLines ? 4 : 2
+        default:
+            return nil
+        }
+    }
+
+    /// Whether `program` only uses assertions the DFA can evaluate.
+    static func supports(_ program: Program, direction: Direction) -> Bool {
+        for (pc, instruction) in program.instructions.enumerated() {
+            guard case .assertion(let assertion) = instruction, initialBit(for: assertion, direction: direction) == nil else { continue }
+            switch (direction, assertion) {
+            case (.forward, .endOfText), (.forward, .endOfTextOrBeforeFinalTerminator), (.reverse, .startOfText):
+                guard leadsOnlyToMatch(program, from: Int32(pc + 1)) else { return false }
+            default:
+                return false
+            }
+        }
+        return true
+    }
+
+    private static func leadsOnlyToMatch(_ program: Program, from pc: Int32) -> Bool {
+        var pc = pc
+        while true {
+            switch program.instructions[Int(pc)] {
+            case .save:
+                pc += 1
+            case .jump(let target):
+                pc = target
+            case .match:
+                return true
+            default:
+                return false
+            }
+        }
+    }
+
+    let program: Program
+    let direction: Direction
+
+    /// The most memory the cache may use, in bytes.
+    let capacity: Int
+
+    private let classes: ScalarClasses
+
+    /// The length of each state's row of transitions: the number of classes
+    /// rounded up to a power of two, so a state's index is its ID shifted.
+    private let stride: Int
+    private let strideShift: Int
+
+    private var keys = [StateKey]()
+    private var index = [StateKey: Int32]()
+    private var transitions = ContiguousArray<Int32>()
+    private var isMatch = ContiguousArray<Bool>()
+    private var hasPending = ContiguousArray<Bool>()
+    private var isDead = ContiguousArray<Bool>()
+    private var startStates = [UInt8: Int32]()
+    private var memoryUsed = 0
+
+    private var marks: ContiguousArray<UInt32>
+    private var generation: UInt32 = 0
+    private var stack = [Int32]()
+    private var building = StateKey()
+    private var buildingHasPending = false
+
+    private var clears = 0
+    private var unitsSinceClear = 0
+    private var statesSinceClear = 0
+
+    init(program: Program, direction: Direction, capacity: Int, classes: ScalarClasses) {
+        self.program = program
+        self.direction = direction
+        self.capacity = capacity
+        self.classes = classes
+        var strideShift = 0
+        while 1 << strideShift < classes.count {
+            strideShift += 1
+        }
+        self.stride = 1 << strideShift
+        self.strideShift = strideShift
+        self.marks = ContiguousArray(repeating: 0, count: program.instructions.count)
+    }
+
+    // MARK: - Determinization
+
+    private func beginBuilding() {
+        generation = generation &+ 1
+        if generation == 0 {
+            for i in marks.indices {
+                marks[i] = 0
+            }
+            generation = 1
+        }
+        building = StateKey()
+        buildingHasPending = false
+    }
+
+    /// Adds the threads reachable from `pc` without consuming input to the
+    /// state being built, given which initial assertions hold. Returns false
+    /// if a forward thread matched, which cuts off every lower-priority
+    /// thread.
+    private func addThreads(from pc: Int32, initial: UInt8) -> Bool {
+        stack.append(pc)
+        while let top = stack.popLast() {
+            var pc = top
+            explore: while marks[Int(pc)] != generation {
+                marks[Int(pc)] = generation
+                switch program.instructions[Int(pc)] {
+                case .jump(let target):
+                    pc = target
+                case let .split(preferred, alternative):
+                    stack.append(alternative)
+                    pc = preferred
+                case .save:
+                    pc += 1
+                case .assertion(let assertion):
+                    if let bit = LazyDFA.initialBit(for: assertion, direction: direction) {
+                        guard initial & bit != 0 else { break explore }
+                        pc += 1
+                    } else {
+                        building.threads.append(pc)
+                        buildingHasPending = true
+                        break explore
+                    }
+                case .scalar, .set:
+                    building.threads.append(pc)
+                    break explore
+                case .match:
+                    building.isMatch = true
+                    guard direction == .forward else { break explore }
+                    stack.removeAll(keepingCapacity: true)
+                    return false
+                }
+            }
+        }
+        return true
+    }
+
+    private func stateMemory(_ key: StateKey) -> Int {
+        return stride * MemoryLayout<Int32>.stride + key.threads.count * MemoryLayout<Int32>.stride + 96
+    }
+
+    private func clearCache() {
+        keys.removeAll(keepingCapacity: true)
+        index.removeAll(keepingCapacity: true)
+        transitions.removeAll(keepingCapacity: true)
+        isMatch.removeAll(keepingCapacity: true)
+        hasPending.removeAll(keepingCapacity: true)
+        isDead.removeAll(keepingCapacity: true)
+        startStates.removeAll(keepingCapacity: true)
+        memoryUsed = 0
+    }
+
+    /// Returns the state for the key just built, adding it to the cache, or
+    /// `nil` if the cache is thrashing. Sets `cleared` if adding it cleared
+    /// the cache, invalidating every other state.
+    private func intern(cleared: inout Bool) -> Int32? {
+        if let existing = index[building] {
+            return existing
+        }
+
+        let size = stateMemory(building)
+        if memoryUsed + size > capacity && !keys.isEmpty {
+            clears += 1
+            if clears > LazyDFA.tolerableClears && unitsSinceClear < statesSinceClear * LazyDFA.minimumUnitsPerState {
+                return nil
+            }
+            clearCache()
+            cleared = true
+            unitsSinceClear = 0
+            statesSinceClear = 0
+        }
+
+        let state = Int32(keys.count << strideShift)
+        keys.append(building)
+        index[building] = state
+        transitions.append(contentsOf: repeatElement(LazyDFA.unknown, count: stride))
+        isMatch.append(building.isMatch)
+        hasPending.append(buildingHasPending)
+        isDead.append(building.threads.isEmpty && !building.isSeeding)
+        memoryUsed += size
+        statesSinceClear += 1
+        return state
+    }
+
+    private func startState(initial: UInt8, seeding: Bool) -> Int32? {
+        let startKey = initial | (seeding ? 0x80 : 0)
+        if let state = startStates[startKey] {
+            return state
+        }
+
+        beginBuilding()
+        _ = addThreads(from: 0, initial: initial)
+        building.isSeeding = seeding && !building.isMatch
+        var cleared = false
+        guard let state = intern(cleared: &cleared) else { return nil }
+        startStates[startKey] = state
+        return state
+    }
+
+    /// Computes the transition on `scalar`, which stands for its whole
+    /// class.
+    private func computeTransition(from state: Int32, on scalar: UInt32, class cls: Int) -> Int32? {
+        let key = keys[Int(state) >> strideShift]
+        beginBuilding()
+
+        var isAlive = true
+        for pc in key.threads {
+            let consumes: Bool
+            switch program.instructions[Int(pc)] {
+            case .scalar(let expected):
+                consumes = scalar == expected
+            case .set(let set):
+                consumes = program.sets[Int(set)].contains(scalar)
+            default:
+                consumes = false
+            }
+            if consumes && !addThreads(from: pc + 1, initial: 0) {
+                isAlive = false
+                break
+            }
+        }
+        if isAlive && key.isSeeding && !key.isMatch {
+            isAlive = addThreads(from: 0, initial: 0)
+            building.isSeeding = isAlive
+        }
+
+        var cleared = false
+        guard let next = intern(cleared: &cleared) else { return nil }
+        if !cleared {
+            transitions[Int(state) + cls] = next
+        }
+        return next
+    }
+
+    /// Returns the state with only the threads of higher priority than the
+    /// one at `index`, which matched.
+    private func cut(_ state: Int32, after index: Int) -> Int32? {
+        let key = keys[Int(state) >> strideShift]
+        beginBuilding()
+        building.threads = Array(key.threads[0 ..< index])
+        building.isMatch = true
+        for pc in building.threads {
+            if case .assertion = program.instructions[Int(pc)] {
+                buildingHasPending = true
+            }
+        }
+        var cleared = false
+        return intern(cleared: &cleared)
+    }
+
+    // MARK: - Searching
+
+    /// Returns the index of the first waiting assertion that holds at
+    /// `position`.
+    private func pendingMatch<Input: SearchText>(in state: Int32, at position: Int, input: Input) -> Int? {
+        for (index, pc) in keys[Int(state) >> strideShift].threads.enumerated() {
+            if case .assertion(let assertion) = program.instructions[Int(pc)], input.holds(assertion, at: position) {
+                return index
+            }
+        }
+        return nil
+    }
+
+    private func initialAssertions<Input: SearchText>(at position: Int, input: Input) -> UInt8 {
+        switch direction {
+        case .forward:
+            return position == input.anchorStart ? 1 : 0
+        case .reverse:
+            var initial: UInt8 = 0
+            if input.holds(.endOfText, at: position) {
+                initial |= 1
+            }
+            if input.holds(.endOfTextOrBeforeFinalTerminator(unixLines: false), at: position) {
+                initial |= 2
+            }
+            if input.holds(.endOfTextOrBeforeFinalTerminator(unixLines: true), at: position) {
+                initial |= 4
+            }
+            return initial
+        }
+    }
+
+    /// Searching forward, finds where the first match that begins at or
+    /// after `start` ends, or just whether there is one if `earliest`.
+    /// Searching in reverse, finds where the longest match that ends at
+    /// `start` begins.
+    ///
+    /// Returns `noMatch` without a match if `monitor` asks to stop, or, in
+    /// an unanchored forward search that is back in its start state, to
+    /// yield, so a search from its `suspendedIndex` carries on.
+    func find<Input: SearchText>(_ input: Input, from start: Int, anchored: Bool, earliest: Bool, monitor: SearchMonitor?) -> Result {
+        let isForward = direction == .forward
+        let isAnchored = anchored || !isForward || program.isAnchoredAtStart
+        if isForward && program.isAnchoredAtStart && start != input.anchorStart {
+            return .noMatch
+        }
+
+        clears = 0
+        unitsSinceClear = 0
+        statesSinceClear = 0
+
+        guard var state = startState(initial: initialAssertions(at: start, input: input), seeding: !isAnchored) else { return .gaveUp }
+        var position = start
+        var lastMatch: Int?
+        var positionsScanned = 0
+
+        while true {
+            let stateIndex = Int(state) >> strideShift
+            if isMatch[stateIndex] {
+                if earliest {
+                    return .match(position)
+                }
+                lastMatch = position
+            } else if hasPending[stateIndex], let index = pendingMatch(in: state, at: position, input: input) {
+                if earliest {
+                    return .match(position)
+                }
+                lastMatch = position
+                if isForward {
+                    guard let cutState = cut(state, after: index) else { return .gaveUp }
+                    state = cutState
+                }
+            }
+            if isDead[Int(state) >> strideShift] || (isForward ? position >= input.end : position <= input.start) {
+                break
+            }
+
+            let (scalar, width) = isForward ? input.scalar(at: position, limit: input.end) : input.scalar(before: position, limit: input.start)
+            let cls = classes.classOf(scalar)
+            var next = transitions[Int(state) + cls]
+            if next == LazyDFA.unknown {
+                guard let computed = computeTransition(from: state, on: scalar, class: cls) else { return .gaveUp }
+                next = computed
+            }
+            state = next
+            position += isForward ? width : -width
+            unitsSinceClear += width
+
+            positionsScanned += 1
+            if let monitor = monitor, positionsScanned % LazyDFA.checkInterval == 0 {
+                guard monitor.shouldContinue(steps: 0) else { return .noMatch }
+                if !isAnchored && lastMatch == nil && state == startStates[0x80] && !monitor.shouldContinueScanning(at: position, positions: LazyDFA.checkInterval) {
+                    return .noMatch
+                }
+            }
+        }
+
+        return lastMatch.map { Result.match($0) } ?? .noMatch
+    }
+
+}
+
+/// Lends out one cached DFA at a time, so concurrent searches don't share a
+/// cache. A search that finds it in use builds a private DFA instead, like
+/// `checkOut(options:)` clones the ICU handle.
+final class DFAPool {
+
+    let program: Program
+    let direction: LazyDFA.Direction
+    let capacity: Int
+    private let classes: ScalarClasses
+    private let semaphore = DispatchSemaphore(value: 1)
+    private let shared: LazyDFA
+
+    init(program: Program, direction: LazyDFA.Direction, capacity: Int) {
+        self.program = program
+        self.direction = direction
+        self.capacity = capacity
+        self.classes = ScalarClasses(program)
+        self.shared = LazyDFA(program: program, direction: direction, capacity: capacity, classes: classes)
+    }
+
+    func withDFA<Result>(_ body: (LazyDFA) throws -> Result) rethrows -> Result {
+        if case .success = semaphore.wait(timeout: .now()) {
+            defer { semaphore.signal() }
+            return try body(shared)
+        }
+        return try body(LazyDFA(program: program, direction: direction, capacity: capacity, classes: classes))
+    }
+
+}
+
+/// Finds exact match spans with DFAs alone: forward to where the first match
+/// ends, then backward from there to where it starts.
+final class DFASearcher {
+
+    enum Span {
+        case found(Range<Int>)
+        case none
+        case gaveUp
+    }
+
+    let forward: DFAPool
+    let reverse: DFAPool?
+
+    /// Searches for a literal in the middle of the pattern, for UTF-16 text,
+    /// if the pattern has one.
+    let innerLiteral: InnerLiteralSearcher?
+
+    init(forward: DFAPool, reverse: DFAPool?, innerLiteral: InnerLiteralSearcher? = nil) {
+        self.forward = forward
+        self.reverse = reverse
+        self.innerLiteral = innerLiteral
+    }
+
+    /// Whether an unanchored search should look for the inner literal: a
+    /// search from the end is faster still.
+    var usesInnerLiteral: Bool {
+        return innerLiteral != nil && !isAnchoredAtEnd
+    }
+
+    /// Whether the pattern ends with `\z`, `\Z` or `$`, so a search can run
+    /// the reverse DFA back from the end of the text without first scanning
+    /// forward to it.
+    var isAnchoredAtEnd: Bool {
+        return forward.program.endAnchor != nil && reverse != nil
+    }
+
+    /// Where every match in `input` must end, if the pattern is anchored at
+    /// the end and there's only one place that can be: `$` may also match
+    /// before a line terminator that ends the text, which is at most three
+    /// UTF-8 bytes, though not between the `\r` and `\n` of a CRLF.
+    private func anchoredEnd<Input: SearchText>(of input: Input) -> Int? {
+        guard let anchor = forward.program.endAnchor, reverse != nil else { return nil }
+        if case .endOfTextOrBeforeFinalTerminator = anchor {
+            for i in max(input.start, input.end - 3) ..< input.end where input.holds(anchor, at: i) {
+                return nil
+            }
+        }
+        return input.end
+    }
+
+    /// Returns whether there is a match at or after `start`.
+    func containsMatch<Input: SearchText>(in input: Input, from start: Int, anchored: Bool, monitor: SearchMonitor?) -> LazyDFA.Result {
+        if !anchored, let reverse = reverse, let end = anchoredEnd(of: input) {
+            return reverse.withDFA { $0.find(input.bounded(from: start, to: end), from: end, anchored: true, earliest: true, monitor: monitor) }
+        }
+        return forward.withDFA { $0.find(input, from: start, anchored: anchored, earliest: true, monitor: monitor) }
+    }
+
+    /// Returns the UTF-16 offsets of the first match at or after `start`.
+    func span<Input: SearchText>(in input: Input, from start: Int, anchored: Bool, monitor: SearchMonitor?) -> Span {
+        // Every match ends at the same place, so the leftmost is the longest
+        // the reverse DFA finds back from there, at the cost of reading only
+        // the match rather than the text before it.
+        if !anchored, let reverse = reverse, let end = anchoredEnd(of: input) {
+            switch reverse.withDFA({ $0.find(input.bounded(from: start, to: end), from: end, anchored: true, earliest: false, monitor: monitor) }) {
+            case .match(let offset):
+                return .found(offset ..< end)
+            case .noMatch:
+                return .none
+            case .gaveUp:
+                break
+            }
+        }
+
+        let end: Int
+        switch forward.withDFA({ $0.find(input, from: start, anchored: anchored, earliest: false, monitor: monitor) }) {
+        case .match(let offset):
+            end = offset
+        case .noMatch:
+            return .none
+        case .gaveUp:
+            return .gaveUp
+        }
+
+        if anchored {
+            return .found(start ..< end)
+        }
+        guard let reverse = reverse else { return .gaveUp }
+
+        // The leftmost match is the one that starts earliest, so it is the
+        // longest match that ends at `end` and doesn't start before `start`.
+        switch reverse.withDFA({ $0.find(input.bounded(from: start, to: end), from: end, anchored: true, earliest: false, monitor: monitor) }) {
+        case .match(let offset):
+            return .found(offset ..< end)
+        case .noMatch:
+            // Only if the search was stopped.
+            return .none
+        case .gaveUp:
+            return .gaveUp
+        }
+    }
+
+}
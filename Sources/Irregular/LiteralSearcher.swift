@@ -0,0 +1,190 @@
+//
+//  LiteralSearcher.swift
+//  Irregular
+//
+
+private let lanes: UInt64 = 0x0001_0001_0001_0001
+private let laneHighBits: UInt64 = 0x8000_8000_8000_8000
+
+private extension UInt16 {
+
+    var isASCIIUppercase: Bool {
+        return self >= 0x41 && self <= 0x5A
+    }
+
+    var isASCIILowercase: Bool {
+        return self >= 0x61 && self <= 0x7A
+    }
+
+}
+
+/// Returns the first index in `start ..< end` whose code unit equals `target`,
+/// comparing four code units at a time.
+///
+/// If `target` is a lowercase ASCII letter and `foldingCase` is set, the
+/// uppercase letter also matches; setting bit 5 folds exactly those two.
+private func scan(for target: UInt16, foldingCase: Bool, in base: UnsafePointer<UInt16>, from start: Int, to end: Int) -> Int? {
+    let fold: UInt16 = foldingCase && target.isASCIILowercase ? 0x20 : 0
+    var i = start
+
+    while i < end && Int(bitPattern: base + i) & 7 != 0 {
+        if base[i] | fold == target { return i }
+        i += 1
+    }
+
+    let broadcast = lanes &* UInt64(target)
+    let broadcastFold = lanes &* UInt64(fold)
+    while i + 4 <= end {
+        let word = UnsafeRawPointer(base + i).load(as: UInt64.self) | broadcastFold
+        let difference = word ^ broadcast
+        if (difference &- lanes) & ~difference & laneHighBits != 0 {
+            break
+        }
+        i += 4
+    }
+
+    while i < end {
+        if base[i] | fold == target { return i }
+        i += 1
+    }
+
+    return nil
+}
+
+/// Splits `needle` at a critical factorization for the Two-Way algorithm,
+/// returning the start of the right half and its period.
+///
+/// The right half is the larger of the maximal suffixes under the two
+/// orderings of code units.
+private func criticalFactorization(of needle: [UInt16]) -> (suffix: Int, period: Int) {
+    func maximalSuffix(reversed: Bool) -> (start: Int, period: Int) {
+        var start = -1
+        var j = 0, k = 1, period = 1
+        while j + k < needle.count {
+            let a = needle[j + k], b = needle[start + k]
+            if reversed ? b < a : a < b {
+                j += k
+                k = 1
+                period = j - start
+            } else if a == b {
+                if k != period {
+                    k += 1
+                } else {
+                    j += period
+                    k = 1
+                }
+            } else {
+                start = j
+                j += 1
+                k = 1
+                period = 1
+            }
+        }
+        return (start + 1, period)
+    }
+
+    let forward = maximalSuffix(reversed: false)
+    let reverse = maximalSuffix(reversed: true)
+    return forward.start >= reverse.start ? (forward.start, forward.period) : (reverse.start, reverse.period)
+}
+
+/// Finds occurrences of a fixed string of UTF-16 code units, optionally
+/// ignoring ASCII case.
+///
+/// Short needles are found by scanning for their first code unit and
+/// comparing the rest; longer ones use the Two-Way algorithm, which never
+/// takes more than linear time, with the same scan to skip ahead whenever it
+/// has no partial match to remember.
+struct LiteralSearcher {
+
+    /// Needles up to this long are verified by direct comparison.
+    private static let shortNeedleLength = 8
+
+    /// The code units searched for; ASCII letters are lowercase if the search
+    /// ignores case.
+    let needle: [UInt16]
+    let isCaseInsensitive: Bool
+
+    private let suffix: Int
+    private let period: Int
+    private let isPeriodic: Bool
+
+    init<C: Collection>(needle: C, caseInsensitive: Bool) where C.Iterator.Element == UInt16 {
+        precondition(!needle.isEmpty, "cannot search for an empty literal")
+        self.needle = needle.map { caseInsensitive && $0.isASCIIUppercase ? $0 | 0x20 : $0 }
+        self.isCaseInsensitive = caseInsensitive
+
+        let (suffix, period) = criticalFactorization(of: self.needle)
+        self.suffix = suffix
+        self.isPeriodic = self.needle[0 ..< suffix].elementsEqual(self.needle[period ..< period + suffix])
+        self.period = isPeriodic ? period : max(suffix, self.needle.count - suffix) + 1
+    }
+
+    private func unit(at position: Int, in base: UnsafePointer<UInt16>) -> UInt16 {
+        let unit = base[position]
+        return isCaseInsensitive && unit.isASCIIUppercase ? unit | 0x20 : unit
+    }
+
+    private func isMatch(at position: Int, in base: UnsafePointer<UInt16>) -> Bool {
+        for (offset, expected) in needle.enumerated() {
+            guard unit(at: position + offset, in: base) == expected else { return false }
+        }
+        return true
+    }
+
+    /// Returns the start of the first occurrence of the needle lying entirely
+    /// within `start ..< end`.
+    func firstOccurrence(in haystack: UnsafeBufferPointer<UInt16>, from start: Int, to end: Int) -> Int? {
+        guard let base = haystack.baseAddress else { return nil }
+        let lastStart = end - needle.count
+        guard needle.count > LiteralSearcher.shortNeedleLength else {
+            var position = start
+            while position <= lastStart {
+                guard let candidate = scan(for: needle[0], foldingCase: isCaseInsensitive, in: base, from: position, to: lastStart + 1) else {
+                    return nil
+                }
+                if isMatch(at: candidate, in: base) {
+                    return candidate
+                }
+                position = candidate + 1
+            }
+            return nil
+        }
+
+        var position = start
+        var memory = 0
+        while position <= lastStart {
+            if memory == 0 {
+                guard let candidate = scan(for: needle[0], foldingCase: isCaseInsensitive, in: base, from: position, to: lastStart + 1) else {
+                    return nil
+                }
+                position = candidate
+            }
+
+            // Match the right half left to right...
+            var i = max(suffix, memory)
+            while i < needle.count && needle[i] == unit(at: position + i, in: base) {
+                i += 1
+            }
+            guard i >= needle.count else {
+                position += i - suffix + 1
+                memory = 0
+                continue
+            }
+
+            // ...then the left half right to left.
+            i = suffix - 1
+            while i >= memory && needle[i] == unit(at: position + i, in: base) {
+                i -= 1
+            }
+            if i < memory {
+                return position
+            }
+
+            position += period
+            memory = isPeriodic ? needle.count - period : 0
+        }
+        return nil
+    }
+
+}
@@ -0,0 +1,144 @@
+//
+//  MatchLimits.swift
+//  Irregular
+//
+
+import Dispatch
+import CUnicode
+
+extension RegularExpression {
+
+    /// Bounds on the work a search may do before it is abandoned with an
+    /// `Error` whose `interruption` is set.
+    ///
+    /// Use these to put a latency bound on untrusted patterns, which can
+    /// backtrack catastrophically.
+    public struct MatchLimits {
+
+        /// Wall-clock time after which every remaining search is abandoned.
+        public var deadline: DispatchTime?
+
+        /// The most match steps a single search may take, as counted by ICU's
+        /// match callback. ICU reports a step roughly every ten thousand
+        /// backtracking operations; the native engines count a step for every
+        /// ten thousand thread transitions.
+        public var maximumSteps: Int?
+
+        public init(deadline: DispatchTime? = nil, maximumSteps: Int? = nil) {
+            self.deadline = deadline
+            self.maximumSteps = maximumSteps
+        }
+
+        public init(timeout: DispatchTimeInterval, maximumSteps: Int? = nil) {
+            self.init(deadline: .now() + timeout, maximumSteps: maximumSteps)
+        }
+
+        var isUnlimited: Bool {
+            return deadline == nil && maximumSteps == nil
+        }
+
+    }
+
+}
+
+/// Enforces `MatchLimits` and polls for cancellation from ICU's match and
+/// find progress callbacks.
+///
+/// ICU only holds an unretained pointer to the monitor; whoever installs it
+/// must keep it alive until the callbacks are cleared.
+final class SearchMonitor {
+
+    /// Reading the clock on every find progress callback is measurable, so it
+    /// is only checked once per this many calls.
+    private static let clockInterval = 256
+
+    let limits: RegularExpression.MatchLimits
+    let cancellation: DispatchWorkItem?
+
+    /// If set, a search is stopped after this many find progress callbacks,
+    /// or start positions passed over by a native search, so its caller can
+    /// yield, and resumed from `suspendedIndex`.
+    let progressInterval: Int?
+
+    private(set) var interruption: RegularExpression.Error.Interruption?
+    private(set) var suspendedIndex: Int64?
+    private var progressCount = 0
+    private var ticks = 0
+
+    init(limits: RegularExpression.MatchLimits, cancellation: DispatchWorkItem? = nil, progressInterval: Int? = nil) {
+        self.limits = limits
+        self.cancellation = cancellation
+        self.progressInterval = progressInterval
+    }
+
+    func install(on handle: UnsafeMutablePointer<URegularExpression>) {
+        var status = UErrorCode.ZERO_ERROR
+        let context = UnsafeRawPointer(Unmanaged.passUnretained(self).toOpaque())
+
+        handle.pointee.setMatchCallback({ (context, steps) -> Int8 in
+            let monitor = Unmanaged<SearchMonitor>.fromOpaque(context!).takeUnretainedValue()
+            return monitor.shouldContinue(steps: Int(steps)) ? 1 : 0
+        }, context: context, status: &status)
+
+        handle.pointee.setFindProgressCallback({ (context, matchIndex) -> Int8 in
+            let monitor = Unmanaged<SearchMonitor>.fromOpaque(context!).takeUnretainedValue()
+            return monitor.shouldContinueFinding(at: matchIndex) ? 1 : 0
+        }, context: context, status: &status)
+    }
+
+    func beginSearch() {
+        interruption = nil
+        suspendedIndex = nil
+        ticks = 0
+        // Check the clock on the first find progress callback.
+        progressCount = SearchMonitor.clockInterval - 1
+        if cancellation?.isCancelled == true {
+            interruption = .cancelled
+        }
+    }
+
+    private var isPastDeadline: Bool {
+        guard let deadline = limits.deadline else { return false }
+        return DispatchTime.now().uptimeNanoseconds >= deadline.uptimeNanoseconds
+    }
+
+    func shouldContinue(steps: Int) -> Bool {
+        if cancellation?.isCancelled == true {
+            interruption = .cancelled
+        } else if let maximumSteps = limits.maximumSteps, steps > maximumSteps {
+            interruption = .stepLimitExceeded
+        } else if isPastDeadline {
+            interruption = .deadlineExceeded
+        }
+        return interruption == nil
+    }
+
+    func shouldContinueFinding(at matchIndex: Int64) -> Bool {
+        progressCount += 1
+        ticks += 1
+        if cancellation?.isCancelled == true {
+            interruption = .cancelled
+        } else if progressCount % SearchMonitor.clockInterval == 0 && isPastDeadline {
+            interruption = .deadlineExceeded
+        } else if let progressInterval = progressInterval, ticks > progressInterval {
+            suspendedIndex = matchIndex
+            return false
+        }
+        return interruption == nil
+    }
+
+    /// Counts `positions` start positions a native search has passed over
+    /// with no match in progress, so it can begin again at `index` and find
+    /// the same matches; like a find progress callback, stops the search
+    /// once there have been `progressInterval` of them.
+    func shouldContinueScanning(at index: Int, positions: Int) -> Bool {
+        guard let progressInterval = progressInterval else { return true }
+        ticks += positions
+        if ticks > progressInterval {
+            suspendedIndex = Int64(index)
+            return false
+        }
+        return true
+    }
+
+}
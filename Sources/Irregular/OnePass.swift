@@ -0,0 +1,199 @@
+//
+//  OnePass.swift
+//  Irregular
+//
+
+/// A matcher for one-pass programs: those where, at every position of an
+/// anchored match, at most one thread can consume the next character.
+///
+/// Patterns like `^(\d{4})-(\d{2})-(\d{2}) (\w+)=(.*)$` are one-pass. Each
+/// state of the matcher is a point in the program after consuming a
+/// character, and each of its transitions carries the capture slots to set
+/// and the assertions to check on the way to the next character, so a match
+/// takes one table lookup per character and no thread lists or backtracking.
+final class OnePass {
+
+    /// An epsilon path through the program from a state.
+    private struct Path {
+        /// The instruction that consumes input at the end of the path, or `-1`
+        /// if the path ends in a match.
+        let target: Int32
+        let saves: [Int32]
+        let assertions: [SyntaxTree.Assertion]
+    }
+
+    /// Programs larger than this aren't analyzed; determining whether they
+    /// are one-pass costs time quadratic in their size.
+    static let maximumProgramSize = 2048
+
+    private static let tableWidth = 128
+    private static let none: Int16 = -1
+
+    let program: Program
+
+    /// Each state's paths, in priority order.
+    private var paths = [[Path]]()
+
+    /// For each state, the index of its path that ends in a match, if any.
+    private var matchPaths = ContiguousArray<Int16>()
+
+    /// For each state, the path that consumes each ASCII character.
+    private var table = ContiguousArray<Int16>()
+
+    /// The state after each consuming instruction, or `-1`.
+    private var stateAfter: ContiguousArray<Int32>
+
+    var stateCount: Int {
+        return paths.count
+    }
+
+    init?(program: Program) {
+        guard program.instructions.count <= OnePass.maximumProgramSize else { return nil }
+        self.program = program
+        self.stateAfter = ContiguousArray(repeating: -1, count: program.instructions.count)
+
+        guard addState(from: 0) else { return nil }
+        var pending = [Int32]()
+        for path in paths[0] where path.target >= 0 {
+            pending.append(path.target)
+        }
+        while let consumer = pending.popLast() {
+            guard stateAfter[Int(consumer)] < 0 else { continue }
+            stateAfter[Int(consumer)] = Int32(paths.count)
+            guard addState(from: consumer + 1) else { return nil }
+            for path in paths[paths.count - 1] where path.target >= 0 && stateAfter[Int(path.target)] < 0 {
+                pending.append(path.target)
+            }
+        }
+    }
+
+    private func characters(consumedBy pc: Int32) -> ScalarSet {
+        switch program.instructions[Int(pc)] {
+        case .scalar(let scalar):
+            return ScalarSet(scalar)
+        case .set(let index):
+            return program.sets[Int(index)]
+        default:
+            return ScalarSet()
+        }
+    }
+
+    /// Adds the state whose paths begin at `start`, returning false if two
+    /// paths could both continue on the same character, or two paths reach
+    /// the same instruction.
+    private func addState(from start: Int32) -> Bool {
+        var found = [Path]()
+        var visited = Set<Int32>()
+        var stack: [(pc: Int32, saves: [Int32], assertions: [SyntaxTree.Assertion])] = [(start, [], [])]
+
+        while let top = stack.popLast() {
+            var (pc, saves, assertions) = (top.pc, top.saves, top.assertions)
+            while true {
+                guard visited.insert(pc).inserted else { return false }
+                switch program.instructions[Int(pc)] {
+                case .jump(let target):
+                    pc = target
+                    continue
+                case let .split(preferred, alternative):
+                    stack.append((alternative, saves, assertions))
+                    pc = preferred
+                    continue
+                case .save(let slot):
+                    saves.append(slot)
+                    pc += 1
+                    continue
+                case .assertion(let assertion):
+                    assertions.append(assertion)
+                    pc += 1
+                    continue
+                case .scalar, .set:
+                    found.append(Path(target: pc, saves: saves, assertions: assertions))
+                case .match:
+                    guard !found.contains(where: { $0.target < 0 }) else { return false }
+                    found.append(Path(target: -1, saves: saves, assertions: assertions))
+                }
+                break
+            }
+        }
+
+        var matchPath = OnePass.none
+        var consumed = [ScalarSet]()
+        var row = ContiguousArray<Int16>(repeating: OnePass.none, count: OnePass.tableWidth)
+        for (index, path) in found.enumerated() {
+            guard path.target >= 0 else {
+                matchPath = Int16(index)
+                continue
+            }
+            let characters = self.characters(consumedBy: path.target)
+            for other in consumed where !other.intersection(characters).isEmpty {
+                return false
+            }
+            consumed.append(characters)
+            for scalar in 0 ..< UInt32(OnePass.tableWidth) where characters.contains(scalar) {
+                row[Int(scalar)] = Int16(index)
+            }
+        }
+
+        paths.append(found)
+        matchPaths.append(matchPath)
+        table.append(contentsOf: row)
+        return true
+    }
+
+    private func holds(_ assertions: [SyntaxTree.Assertion], at position: Int, input: SearchInput) -> Bool {
+        for assertion in assertions where !input.holds(assertion, at: position) {
+            return false
+        }
+        return true
+    }
+
+    /// Returns the capture slots of the match that begins exactly at `start`.
+    func match(_ input: SearchInput, at start: Int) -> ContiguousArray<Int>? {
+        var slots = ContiguousArray<Int>(repeating: -1, count: program.slotCount)
+        var matched: ContiguousArray<Int>?
+        var state = 0
+        var position = start
+
+        while true {
+            let statePaths = paths[state]
+
+            var next = Int(OnePass.none)
+            var width = 0
+            if position < input.end {
+                let decoded = input.scalar(at: position, limit: input.end)
+                let scalar = decoded.value
+                width = decoded.width
+                if scalar < UInt32(OnePass.tableWidth) {
+                    next = Int(table[state * OnePass.tableWidth + Int(scalar)])
+                } else if let index = statePaths.index(where: { $0.target >= 0 && characters(consumedBy: $0.target).contains(scalar) }) {
+                    next = index
+                }
+                if next >= 0 && !holds(statePaths[next].assertions, at: position, input: input) {
+                    next = Int(OnePass.none)
+                }
+            }
+
+            let matchPath = Int(matchPaths[state])
+            if matchPath >= 0 && holds(statePaths[matchPath].assertions, at: position, input: input) {
+                var candidate = slots
+                for slot in statePaths[matchPath].saves {
+                    candidate[Int(slot)] = position
+                }
+                // A match preferred over continuing ends the search.
+                if next < 0 || matchPath < next {
+                    return candidate
+                }
+                matched = candidate
+            }
+
+            guard next >= 0 else { return matched }
+            let path = statePaths[next]
+            for slot in path.saves {
+                slots[Int(slot)] = position
+            }
+            state = Int(stateAfter[Int(path.target)])
+            position += width
+        }
+    }
+
+}
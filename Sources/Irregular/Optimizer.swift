@@ -0,0 +1,567 @@
+//
+//  Optimizer.swift
+//  Irregular
+//
+
+extension RegularExpression {
+
+    /// The rewrites made to a parsed pattern before it is compiled for the
+    /// native engines.
+    public enum OptimizationPass: String {
+        /// Concatenations and alternations nested in their own kind are
+        /// spliced into it, and groups of one element replaced by it.
+        case flatten = "flatten nested groups"
+        /// Alternatives that begin with the same literal share it, so
+        /// `foo|foobar|fob` becomes `fo(?:o(?:|bar)|b)`, and an engine
+        /// following them all tracks one path until they differ.
+        case factorLiterals = "factor alternation literals"
+        /// Adjacent alternatives of one character, like `a|[bc]|d`, become
+        /// one class.
+        case mergeClasses = "merge adjacent classes"
+        /// Possessive repetitions of a character that what follows can't
+        /// begin with, like `\d++\.`, become greedy: they never give back
+        /// what they match either way, and the native engines, which don't
+        /// backtrack, can run greedy ones.
+        case relaxPossessive = "relax possessive quantifiers"
+        /// Capture groups are removed from the pattern the DFAs and the
+        /// bit-parallel NFA run, which only find where matches are.
+        case removeCaptures = "remove captures"
+        /// A leading repetition of a character, like `.*`, is removed from
+        /// the pattern the bit-parallel NFA runs, which only finds whether
+        /// there's a match: the rest is instead allowed to begin after any
+        /// run of the character, as if the search were unanchored.
+        case stripLeadingRepetition = "strip leading repetition"
+    }
+
+    /// The effect of one optimization pass.
+    public struct Optimization {
+        public let pass: OptimizationPass
+
+        /// The number of nodes the pass replaced.
+        public let rewrites: Int
+
+        /// The pattern after the pass, written back out.
+        public let pattern: String
+    }
+
+}
+
+/// A parsed pattern rewritten for each kind of search: finding matches with
+/// their capture groups, finding only where they are, and finding only
+/// whether there is one.
+struct OptimizedSyntax {
+
+    let captures: SyntaxTree
+    let spans: SyntaxTree
+    let existence: SyntaxTree
+
+    /// The passes that were run, in order.
+    let passes: [RegularExpression.Optimization]
+
+    init(_ parsed: SyntaxTree) {
+        var tree = parsed
+        var passes = [RegularExpression.Optimization]()
+        func record(_ pass: RegularExpression.OptimizationPass, _ rewrites: Int) {
+            passes.append(RegularExpression.Optimization(pass: pass, rewrites: rewrites, pattern: tree.pattern))
+        }
+        func run(_ pass: RegularExpression.OptimizationPass, _ rewrite: (inout SyntaxTree, SyntaxTree.NodeIndex) -> SyntaxTree.NodeIndex?) {
+            var rewrites = 0
+            tree.root = tree.transform(tree.root, rewrite, rewrites: &rewrites)
+            record(pass, rewrites)
+        }
+
+        run(.flatten, SyntaxTree.flatten)
+        run(.factorLiterals, SyntaxTree.factorLiterals)
+        run(.mergeClasses, SyntaxTree.mergeClasses)
+        var relaxed = 0
+        tree.root = tree.relaxPossessive(tree.root, followedBy: ScalarSet(), rewrites: &relaxed)
+        record(.relaxPossessive, relaxed)
+        captures = tree
+
+        // Backreferences need the groups they refer to.
+        if !tree.features.contains(.backreferences) {
+            var removed = 0
+            tree.root = tree.transform(tree.root, SyntaxTree.removeCapture, rewrites: &removed)
+            tree.captureCount = 0
+            tree.captureNames = [:]
+            record(.removeCaptures, removed)
+            if removed > 0 {
+                run(.flatten, SyntaxTree.flatten)
+            }
+        }
+        spans = tree
+
+        record(.stripLeadingRepetition, tree.stripLeadingRepetition() ? 1 : 0)
+        existence = tree
+
+        self.passes = passes
+    }
+
+}
+
+extension SyntaxTree {
+
+    /// Rebuilds `node` from the bottom up, replacing each node, after its
+    /// children, with what `rewrite` returns for it, if anything.
+    ///
+    /// Replaced nodes stay in the arena, unreferenced.
+    fileprivate mutating func transform(_ node: NodeIndex, _ rewrite: (inout SyntaxTree, NodeIndex) -> NodeIndex?, rewrites: inout Int) -> NodeIndex {
+        var rebuilt = node
+        switch self[node] {
+        case let .capture(number, body):
+            let newBody = transform(body, rewrite, rewrites: &rewrites)
+            if newBody != body {
+                rebuilt = add(.capture(number, newBody), span: span(of: node))
+            }
+        case let .repetition(body, min, max, repetition):
+            let newBody = transform(body, rewrite, rewrites: &rewrites)
+            if newBody != body {
+                rebuilt = add(.repetition(newBody, min: min, max: max, repetition), span: span(of: node))
+            }
+        case let .lookaround(body, kind):
+            let newBody = transform(body, rewrite, rewrites: &rewrites)
+            if newBody != body {
+                rebuilt = add(.lookaround(newBody, kind), span: span(of: node))
+            }
+        case .atomic(let body):
+            let newBody = transform(body, rewrite, rewrites: &rewrites)
+            if newBody != body {
+                rebuilt = add(.atomic(newBody), span: span(of: node))
+            }
+        case let .concatenation(start, end):
+            let original = Array(children(from: start, to: end))
+            var transformed = [NodeIndex]()
+            for child in original {
+                transformed.append(transform(child, rewrite, rewrites: &rewrites))
+            }
+            if transformed != original {
+                let (newStart, newEnd) = addChildren(transformed)
+                rebuilt = add(.concatenation(newStart, newEnd), span: span(of: node))
+            }
+        case let .alternation(start, end):
+            let original = Array(children(from: start, to: end))
+            var transformed = [NodeIndex]()
+            for child in original {
+                transformed.append(transform(child, rewrite, rewrites: &rewrites))
+            }
+            if transformed != original {
+                let (newStart, newEnd) = addChildren(transformed)
+                rebuilt = add(.alternation(newStart, newEnd), span: span(of: node))
+            }
+        case .empty, .literal, .set, .assertion, .backreference, .graphemeCluster:
+            break
+        }
+
+        guard let replacement = rewrite(&self, rebuilt) else { return rebuilt }
+        rewrites += 1
+        return replacement
+    }
+
+    /// Adds a concatenation of `nodes`, or the node itself if there's one.
+    fileprivate mutating func concatenation(of nodes: [NodeIndex], span: Range<Int32>) -> NodeIndex {
+        switch nodes.count {
+        case 0:
+            return add(.empty, span: span)
+        case 1:
+            return nodes[0]
+        default:
+            let (start, end) = addChildren(nodes)
+            return add(.concatenation(start, end), span: span)
+        }
+    }
+
+    /// Adds an alternation of `branches`, or the branch itself if there's one.
+    fileprivate mutating func alternation(of branches: [NodeIndex], span: Range<Int32>) -> NodeIndex {
+        guard branches.count > 1 else { return branches[0] }
+        let (start, end) = addChildren(branches)
+        return add(.alternation(start, end), span: span)
+    }
+
+    /// The code points `node` matches, if it matches exactly one.
+    fileprivate func singleCharacter(_ node: NodeIndex) -> ScalarSet? {
+        switch self[node] {
+        case let .literal(scalar, caseInsensitive):
+            // ICU may match this against more than one character.
+            guard !caseInsensitive || !CaseFolding.shared.multipleFoldings.contains(scalar) else { return nil }
+            return caseInsensitive ? ScalarSet(scalar).caseClosed() : ScalarSet(scalar)
+        case .set(let index):
+            return set(at: index)
+        default:
+            return nil
+        }
+    }
+
+    /// The code points a match of `node` can begin with, and whether it can
+    /// be empty, or `nil` if that depends on more than the next character,
+    /// as with assertions.
+    fileprivate func firstCharacters(_ node: NodeIndex) -> (set: ScalarSet, isNullable: Bool)? {
+        switch self[node] {
+        case .empty:
+            return (ScalarSet(), true)
+        case .literal, .set:
+            guard let set = singleCharacter(node) else { return nil }
+            return (set, false)
+        case .capture(_, let body):
+            return firstCharacters(body)
+        case let .concatenation(start, end):
+            var set = ScalarSet()
+            for child in children(from: start, to: end) {
+                guard let first = firstCharacters(child) else { return nil }
+                set = set.union(first.set)
+                if !first.isNullable {
+                    return (set, false)
+                }
+            }
+            return (set, true)
+        case let .alternation(start, end):
+            var set = ScalarSet()
+            var isNullable = false
+            for branch in children(from: start, to: end) {
+                guard let first = firstCharacters(branch) else { return nil }
+                set = set.union(first.set)
+                isNullable = isNullable || first.isNullable
+            }
+            return (set, isNullable)
+        case let .repetition(body, min, _, _):
+            guard let first = firstCharacters(body) else { return nil }
+            return (first.set, first.isNullable || min == 0)
+        case .assertion, .lookaround, .atomic, .backreference, .graphemeCluster:
+            return nil
+        }
+    }
+
+    // MARK: - Passes
+
+    fileprivate static func flatten(_ tree: inout SyntaxTree, _ node: NodeIndex) -> NodeIndex? {
+        switch tree[node] {
+        case let .concatenation(start, end):
+            let children = Array(tree.children(from: start, to: end))
+            var flattened = [NodeIndex]()
+            for child in children {
+                switch tree[child] {
+                case let .concatenation(innerStart, innerEnd):
+                    flattened.append(contentsOf: tree.children(from: innerStart, to: innerEnd))
+                case .empty:
+                    break
+                default:
+                    flattened.append(child)
+                }
+            }
+            guard flattened != children || flattened.count < 2 else { return nil }
+            return tree.concatenation(of: flattened, span: tree.span(of: node))
+        case let .alternation(start, end):
+            let branches = Array(tree.children(from: start, to: end))
+            var flattened = [NodeIndex]()
+            for branch in branches {
+                if case let .alternation(innerStart, innerEnd) = tree[branch] {
+                    flattened.append(contentsOf: tree.children(from: innerStart, to: innerEnd))
+                } else {
+                    flattened.append(branch)
+                }
+            }
+            guard flattened != branches || flattened.count == 1 else { return nil }
+            return tree.alternation(of: flattened, span: tree.span(of: node))
+        default:
+            return nil
+        }
+    }
+
+    fileprivate static func factorLiterals(_ tree: inout SyntaxTree, _ node: NodeIndex) -> NodeIndex? {
+        guard case let .alternation(start, end) = tree[node] else { return nil }
+        var branches = [[NodeIndex]]()
+        for branch in tree.children(from: start, to: end) {
+            branches.append(tree.sequence(of: branch))
+        }
+
+        // Only adjacent alternatives are factored, which keeps their order of
+        // priority.
+        var hasSharedLiteral = false
+        for (previous, next) in zip(branches, branches.dropFirst()) {
+            if let a = previous.first, let b = next.first, tree.isSameLiteral(a, b) {
+                hasSharedLiteral = true
+            }
+        }
+        guard hasSharedLiteral else { return nil }
+        return tree.factor(branches, span: tree.span(of: node))
+    }
+
+    /// The elements of `branch` in order.
+    private func sequence(of branch: NodeIndex) -> [NodeIndex] {
+        switch self[branch] {
+        case let .concatenation(start, end):
+            return Array(children(from: start, to: end))
+        case .empty:
+            return []
+        default:
+            return [branch]
+        }
+    }
+
+    private func isSameLiteral(_ a: NodeIndex, _ b: NodeIndex) -> Bool {
+        guard case let .literal(x, xCaseInsensitive) = self[a], case let .literal(y, yCaseInsensitive) = self[b] else { return false }
+        return x == y && xCaseInsensitive == yCaseInsensitive
+    }
+
+    /// Adds an alternation of `branches` as a trie: each run of adjacent
+    /// branches beginning with the same literal becomes that literal followed
+    /// by the alternation of their rests.
+    private mutating func factor(_ branches: [[NodeIndex]], span: Range<Int32>) -> NodeIndex {
+        var alternatives = [NodeIndex]()
+        var i = 0
+        while i < branches.count {
+            var j = i + 1
+            if let head = branches[i].first, case .literal = self[head] {
+                while j < branches.count, let other = branches[j].first, isSameLiteral(head, other) {
+                    j += 1
+                }
+            }
+
+            if j - i > 1 {
+                let rest = factor(branches[i ..< j].map { Array($0.dropFirst()) }, span: span)
+                alternatives.append(concatenation(of: [branches[i][0]] + sequence(of: rest), span: span))
+            } else {
+                alternatives.append(concatenation(of: branches[i], span: span))
+            }
+            i = j
+        }
+        return alternation(of: alternatives, span: span)
+    }
+
+    fileprivate static func mergeClasses(_ tree: inout SyntaxTree, _ node: NodeIndex) -> NodeIndex? {
+        guard case let .alternation(start, end) = tree[node] else { return nil }
+        let branches = Array(tree.children(from: start, to: end))
+
+        // Only adjacent alternatives are merged: `a|b.|c` can't become
+        // `[ac]|b.` without changing which match is preferred.
+        var merged = [NodeIndex]()
+        var isChanged = false
+        var i = 0
+        while i < branches.count {
+            guard var set = tree.singleCharacter(branches[i]) else {
+                merged.append(branches[i])
+                i += 1
+                continue
+            }
+            var j = i + 1
+            while j < branches.count, let next = tree.singleCharacter(branches[j]) {
+                set = set.union(next)
+                j += 1
+            }
+
+            if j - i > 1 {
+                let index = tree.add(set)
+                let span = tree.span(of: branches[i]).lowerBound ..< tree.span(of: branches[j - 1]).upperBound
+                merged.append(tree.add(.set(index), span: span))
+                isChanged = true
+            } else {
+                merged.append(branches[i])
+            }
+            i = j
+        }
+        return isChanged ? tree.alternation(of: merged, span: tree.span(of: node)) : nil
+    }
+
+    /// Rebuilds `node` with possessive repetitions made greedy wherever
+    /// that can't change what matches.
+    ///
+    /// A possessive repetition of a single character keeps every repetition
+    /// it can; a greedy one only gives some back if what follows can't match
+    /// otherwise, and if what follows can't begin with the character either,
+    /// giving some back never helps. `following` is what may come after
+    /// `node`, or `nil` if that isn't known.
+    fileprivate mutating func relaxPossessive(_ node: NodeIndex, followedBy following: ScalarSet?, rewrites: inout Int) -> NodeIndex {
+        switch self[node] {
+        case let .repetition(body, min, max, repetition):
+            if repetition == .possessive, let repeated = singleCharacter(body), let following = following, following.intersection(repeated).isEmpty {
+                rewrites += 1
+                return add(.repetition(body, min: min, max: max, .greedy), span: span(of: node))
+            }
+            let bodyFollowing = firstCharacters(body).flatMap { first in following.map { $0.union(first.set) } }
+            let newBody = relaxPossessive(body, followedBy: bodyFollowing, rewrites: &rewrites)
+            return newBody == body ? node : add(.repetition(newBody, min: min, max: max, repetition), span: span(of: node))
+        case let .capture(number, body):
+            let newBody = relaxPossessive(body, followedBy: following, rewrites: &rewrites)
+            return newBody == body ? node : add(.capture(number, newBody), span: span(of: node))
+        case let .concatenation(start, end):
+            let original = Array(children(from: start, to: end))
+            var relaxed = original
+            var following = following
+            for i in original.indices.reversed() {
+                relaxed[i] = relaxPossessive(original[i], followedBy: following, rewrites: &rewrites)
+                if let first = firstCharacters(original[i]) {
+                    following = first.isNullable ? following.map { $0.union(first.set) } : first.set
+                } else {
+                    following = nil
+                }
+            }
+            guard relaxed != original else { return node }
+            let (newStart, newEnd) = addChildren(relaxed)
+            return add(.concatenation(newStart, newEnd), span: span(of: node))
+        case let .alternation(start, end):
+            let original = Array(children(from: start, to: end))
+            var relaxed = [NodeIndex]()
+            for branch in original {
+                relaxed.append(relaxPossessive(branch, followedBy: following, rewrites: &rewrites))
+            }
+            guard relaxed != original else { return node }
+            let (newStart, newEnd) = addChildren(relaxed)
+            return add(.alternation(newStart, newEnd), span: span(of: node))
+        case let .lookaround(body, kind):
+            let newBody = relaxPossessive(body, followedBy: nil, rewrites: &rewrites)
+            return newBody == body ? node : add(.lookaround(newBody, kind), span: span(of: node))
+        case .atomic(let body):
+            let newBody = relaxPossessive(body, followedBy: nil, rewrites: &rewrites)
+            return newBody == body ? node : add(.atomic(newBody), span: span(of: node))
+        case .empty, .literal, .set, .assertion, .backreference, .graphemeCluster:
+            return node
+        }
+    }
+
+    fileprivate static func removeCapture(_ tree: inout SyntaxTree, _ node: NodeIndex) -> NodeIndex? {
+        guard case .capture(_, let body) = tree[node] else { return nil }
+        return body
+    }
+
+    /// Moves a leading unbounded repetition of one character into
+    /// `unanchoredPrefix`, returning whether there was one.
+    fileprivate mutating func stripLeadingRepetition() -> Bool {
+        if let set = leadingRepetition(root) {
+            unanchoredPrefix = set
+            root = add(.empty, span: span(of: root))
+            return true
+        }
+        guard case let .concatenation(start, end) = self[root] else { return false }
+        let elements = Array(children(from: start, to: end))
+        guard let set = leadingRepetition(elements[0]) else { return false }
+        unanchoredPrefix = set
+        root = concatenation(of: Array(elements.dropFirst()), span: span(of: root))
+        return true
+    }
+
+    /// The code points `node` repeats, if it is `X*` or `X*?` for a single
+    /// character `X`.
+    private func leadingRepetition(_ node: NodeIndex) -> ScalarSet? {
+        guard case let .repetition(body, 0, max, repetition) = self[node], max < 0, repetition != .possessive else { return nil }
+        return singleCharacter(body)
+    }
+
+    // MARK: - Printing
+
+    /// The tree written out as a pattern ICU accepts.
+    var pattern: String {
+        var names = [Int32: String]()
+        for (name, number) in captureNames {
+            names[Int32(number)] = name
+        }
+
+        // Alternations bind loosest, then concatenations, then everything
+        // else.
+        func precedence(_ node: NodeIndex) -> Int {
+            switch self[node] {
+            case .alternation:
+                return 0
+            case .concatenation, .empty:
+                return 1
+            default:
+                return 2
+            }
+        }
+        func grouped(_ node: NodeIndex, atLeast minimum: Int) -> String {
+            let written = write(node)
+            return precedence(node) < minimum ? "(?:\(written))" : written
+        }
+        func write(_ node: NodeIndex) -> String {
+            switch self[node] {
+            case .empty:
+                return ""
+            case let .literal(scalar, caseInsensitive):
+                let escaped = SyntaxTree.escape(scalar, inSet: false)
+                return caseInsensitive ? "(?i:\(escaped))" : escaped
+            case .set(let index):
+                return SyntaxTree.write(set(at: index))
+            case .assertion(let assertion):
+                return SyntaxTree.write(assertion)
+            case let .capture(number, body):
+                let opening = names[number].map { "(?<\($0)>" } ?? "("
+                return opening + write(body) + ")"
+            case let .concatenation(start, end):
+                return children(from: start, to: end).map { grouped($0, atLeast: 1) }.joined()
+            case let .alternation(start, end):
+                return children(from: start, to: end).map { grouped($0, atLeast: 1) }.joined(separator: "|")
+            case let .repetition(body, min, max, repetition):
+                var quantifier: String
+                switch (min, max) {
+                case (0, -1): quantifier = "*"
+                case (1, -1): quantifier = "+"
+                case (0, 1): quantifier = "?"
+                case (_, -1): quantifier = "{\(min),}"
+                case _ where min == max: quantifier = "{\(min)}"
+                default: quantifier = "{\(min),\(max)}"
+                }
+                switch repetition {
+                case .greedy: break
+                case .lazy: quantifier += "?"
+                case .possessive: quantifier += "+"
+                }
+                return grouped(body, atLeast: 2) + quantifier
+            case let .lookaround(body, kind):
+                let opening: String
+                switch kind {
+                case .ahead: opening = "(?="
+                case .negativeAhead: opening = "(?!"
+                case .behind: opening = "(?<="
+                case .negativeBehind: opening = "(?<!"
+                }
+                return opening + write(body) + ")"
+            case .atomic(let body):
+                return "(?>" + write(body) + ")"
+            case let .backreference(number, caseInsensitive):
+                return caseInsensitive ? "(?i:\\\(number))" : "\\\(number)"
+            case .graphemeCluster:
+                return "\\X"
+            }
+        }
+        return write(root)
+    }
+
+    private static func escape(_ scalar: UInt32, inSet: Bool) -> String {
+        let metacharacters: String.UnicodeScalarView = inSet ? "\\[]^-&".unicodeScalars : "\\^$.|?*+()[]{}".unicodeScalars
+        guard scalar >= 0x20 && scalar < 0x7F, let character = UnicodeScalar(scalar) else {
+            return "\\x{" + String(scalar, radix: 16, uppercase: true) + "}"
+        }
+        if metacharacters.contains(character) {
+            return "\\" + String(character)
+        }
+        return String(character)
+    }
+
+    private static func write(_ set: ScalarSet) -> String {
+        if set.isFull {
+            return "(?s:.)"
+        }
+        let inverted = set.inverted()
+        let isNegated = inverted.rangeCount < set.rangeCount
+        var written = isNegated ? "[^" : "["
+        for range in (isNegated ? inverted : set).ranges {
+            written += escape(range.lowerBound, inSet: true)
+            if range.upperBound > range.lowerBound {
+                written += "-" + escape(range.upperBound, inSet: true)
+            }
+        }
+        return written + "]"
+    }
+
+    private static func write(_ assertion: Assertion) -> String {
+        switch assertion {
+        case .startOfText: return "\\A"
+        case .endOfText: return "\\z"
+        case .endOfTextOrBeforeFinalTerminator: return "\\Z"
+        case .startOfLine: return "(?m:^)"
+        case .endOfLine: return "(?m:$)"
+        case .wordBoundary: return "\\b"
+        case .notWordBoundary: return "\\B"
+        case .previousMatchEnd: return "\\G"
+        }
+    }
+
+}
@@ -0,0 +1,760 @@
+//
+//  Parser.swift
+//  Irregular
+//
+
+import CUnicode
+
+private let anyExceptLineTerminators = ScalarSet.all.subtracting(.lineTerminators)
+private let anyExceptNewline = ScalarSet.all.subtracting(ScalarSet(0x0A))
+
+private extension UnicodeScalar {
+
+    var isPatternWhitespace: Bool {
+        switch value {
+        case 0x09 ... 0x0D, 0x20, 0x85, 0x200E, 0x200F, 0x2028, 0x2029:
+            return true
+        default:
+            return false
+        }
+    }
+
+    var isASCIIAlphanumeric: Bool {
+        return ("a" ... "z").contains(self) || ("A" ... "Z").contains(self) || ("0" ... "9").contains(self)
+    }
+
+    var decimalValue: Int32? {
+        return ("0" ... "9").contains(self) ? Int32(value - 0x30) : nil
+    }
+
+    var hexadecimalValue: UInt32? {
+        switch self {
+        case "0" ... "9": return value - 0x30
+        case "a" ... "f": return value - 0x61 + 10
+        case "A" ... "F": return value - 0x41 + 10
+        default: return nil
+        }
+    }
+
+}
+
+/// Parses the ICU regular expression syntax into a `SyntaxTree`.
+///
+/// Errors use ICU's error codes and report the line and offset within the
+/// line like ICU's `UParseError`. A pattern ICU accepts but this parser
+/// doesn't (such as one using `\N{name}`) is simply left to ICU.
+struct Parser {
+
+    private let pattern: String
+    private let scalars: [UnicodeScalar]
+    private let offsets: [Int32]
+    private let options: RegularExpression.Options
+    private var position = 0
+    private var flags: SyntaxTree.Flags
+    private var tree = SyntaxTree()
+
+    private init(pattern: String, options: RegularExpression.Options) {
+        self.pattern = pattern
+        self.scalars = Array(pattern.unicodeScalars)
+        self.options = options
+        self.flags = SyntaxTree.Flags(options)
+
+        var offsets = [Int32]()
+        offsets.reserveCapacity(scalars.count + 1)
+        var offset: Int32 = 0
+        for scalar in scalars {
+            offsets.append(offset)
+            offset += scalar.value > 0xFFFF ? 2 : 1
+        }
+        offsets.append(offset)
+        self.offsets = offsets
+    }
+
+    static func parse(_ pattern: String, options: RegularExpression.Options) throws -> SyntaxTree {
+        var parser = Parser(pattern: pattern, options: options)
+        if options.contains(.ignoreMetacharacters) {
+            parser.tree.root = parser.parseLiteralPattern()
+        } else {
+            parser.tree.root = try parser.parseAlternation()
+            if !parser.isAtEnd {
+                throw parser.error(.REGEX_MISMATCHED_PAREN, at: parser.position)
+            }
+        }
+        return parser.tree
+    }
+
+    // MARK: - Scanning
+
+    private var isAtEnd: Bool {
+        return position >= scalars.count
+    }
+
+    private func peek(_ ahead: Int = 0) -> UnicodeScalar? {
+        return position + ahead < scalars.count ? scalars[position + ahead] : nil
+    }
+
+    private mutating func consume(_ scalar: UnicodeScalar) -> Bool {
+        guard peek() == scalar else { return false }
+        position += 1
+        return true
+    }
+
+    private func span(from start: Int) -> Range<Int32> {
+        return offsets[start] ..< offsets[position]
+    }
+
+    private func error(_ code: UErrorCode, at index: Int) -> RegularExpression.Error {
+        var line: Int32 = 1
+        var lineStart = 0
+        for i in 0 ..< min(index, scalars.count) where scalars[i] == "\n" {
+            line += 1
+            lineStart = i + 1
+        }
+        return RegularExpression.Error(pattern: pattern, code: code, line: line, offset: offsets[min(index, scalars.count)] - offsets[lineStart])
+    }
+
+    /// Skips white space and comments in free-spacing mode.
+    private mutating func skipTrivia() {
+        guard flags.contains(.allowCommentsAndWhitespace) else { return }
+        while let scalar = peek() {
+            if scalar.isPatternWhitespace {
+                position += 1
+            } else if scalar == "#" {
+                while let scalar = peek(), scalar != "\n" {
+                    position += 1
+                }
+            } else {
+                break
+            }
+        }
+    }
+
+    private mutating func parseNumber() -> Int32? {
+        var value: Int32?
+        while let digit = peek()?.decimalValue {
+            let (multiplied, overflow1) = Int32.multiplyWithOverflow(value ?? 0, 10)
+            let (added, overflow2) = Int32.addWithOverflow(multiplied, digit)
+            value = overflow1 || overflow2 ? Int32.max : added
+            position += 1
+        }
+        return value
+    }
+
+    // MARK: - Nodes
+
+    private mutating func literal(_ value: UInt32, from start: Int) -> SyntaxTree.NodeIndex {
+        return tree.add(.literal(value, caseInsensitive: flags.contains(.caseInsensitive)), span: span(from: start))
+    }
+
+    private mutating func set(_ set: ScalarSet, from start: Int) -> SyntaxTree.NodeIndex {
+        return tree.add(.set(tree.add(set)), span: span(from: start))
+    }
+
+    private mutating func concatenation(_ items: [SyntaxTree.NodeIndex], from start: Int) -> SyntaxTree.NodeIndex {
+        switch items.count {
+        case 0:
+            return tree.add(.empty, span: span(from: start))
+        case 1:
+            return items[0]
+        default:
+            noteFullCaseFolding(in: items)
+            let (childrenStart, childrenEnd) = tree.addChildren(items)
+            return tree.add(.concatenation(childrenStart, childrenEnd), span: span(from: start))
+        }
+    }
+
+    /// ICU matches a run of literals as a string, and folds case-insensitive
+    /// strings fully, so `(?i)ss` also matches `ß`. Engines that fold each
+    /// code point alone can't match runs with a character that folds to
+    /// several.
+    private mutating func noteFullCaseFolding(in items: [SyntaxTree.NodeIndex]) {
+        var runLength = 0
+        var foldsFully = false
+        for item in items {
+            guard case let .literal(scalar, caseInsensitive) = tree[item] else {
+                runLength = 0
+                foldsFully = false
+                continue
+            }
+            runLength += 1
+            foldsFully = foldsFully || (caseInsensitive && CaseFolding.shared.multipleFoldings.contains(scalar))
+            if runLength > 1 && foldsFully {
+                tree.features.insert(.fullCaseFolding)
+                return
+            }
+        }
+    }
+
+    private mutating func parseLiteralPattern() -> SyntaxTree.NodeIndex {
+        var items = [SyntaxTree.NodeIndex]()
+        while !isAtEnd {
+            let start = position
+            position += 1
+            items.append(literal(scalars[start].value, from: start))
+        }
+        return concatenation(items, from: 0)
+    }
+
+    private mutating func parseAlternation() throws -> SyntaxTree.NodeIndex {
+        let start = position
+        var branches = [try parseConcatenation()]
+        while consume("|") {
+            branches.append(try parseConcatenation())
+        }
+        guard branches.count > 1 else { return branches[0] }
+        let (childrenStart, childrenEnd) = tree.addChildren(branches)
+        return tree.add(.alternation(childrenStart, childrenEnd), span: span(from: start))
+    }
+
+    private mutating func parseConcatenation() throws -> SyntaxTree.NodeIndex {
+        let start = position
+        var items = [SyntaxTree.NodeIndex]()
+        while true {
+            skipTrivia()
+            guard let scalar = peek(), scalar != "|", scalar != ")" else { break }
+            if let item = try parseQuantified() {
+                items.append(item)
+            }
+        }
+        return concatenation(items, from: start)
+    }
+
+    private mutating func parseQuantified() throws -> SyntaxTree.NodeIndex? {
+        let start = position
+        guard var atom = try parseAtom() else { return nil }
+        while true {
+            skipTrivia()
+            let bounds: (min: Int32, max: Int32)
+            if consume("*") {
+                bounds = (0, -1)
+            } else if consume("+") {
+                bounds = (1, -1)
+            } else if consume("?") {
+                bounds = (0, 1)
+            } else if peek() == "{" {
+                bounds = try parseInterval()
+            } else {
+                break
+            }
+
+            let repetition: SyntaxTree.Repetition
+            if consume("?") {
+                repetition = .lazy
+            } else if consume("+") {
+                repetition = .possessive
+                tree.features.insert(.atomicGroups)
+            } else {
+                repetition = .greedy
+            }
+            atom = tree.add(.repetition(atom, min: bounds.min, max: bounds.max, repetition), span: span(from: start))
+        }
+        return atom
+    }
+
+    private mutating func parseInterval() throws -> (min: Int32, max: Int32) {
+        let start = position
+        position += 1
+        guard let min = parseNumber() else {
+            throw error(.REGEX_BAD_INTERVAL, at: position)
+        }
+        var max = min
+        if consume(",") {
+            max = parseNumber() ?? -1
+        }
+        guard consume("}") else {
+            throw error(.REGEX_BAD_INTERVAL, at: position)
+        }
+        guard min != Int32.max && max != Int32.max else {
+            throw error(.REGEX_NUMBER_TOO_BIG, at: start)
+        }
+        guard max < 0 || max >= min else {
+            throw error(.REGEX_MAX_LT_MIN, at: start)
+        }
+        return (min, max)
+    }
+
+    private mutating func parseAtom() throws -> SyntaxTree.NodeIndex? {
+        let start = position
+        let scalar = scalars[position]
+        switch scalar {
+        case "(":
+            return try parseGroup()
+        case "[":
+            return set(try parseSetExpression(), from: start)
+        case ".":
+            position += 1
+            if flags.contains(.dotMatchesLineSeparators) {
+                tree.features.insert(.dotMatchingCRLF)
+                return set(.all, from: start)
+            } else if flags.contains(.useUnixLineSeparators) {
+                return set(anyExceptNewline, from: start)
+            } else {
+                return set(anyExceptLineTerminators, from: start)
+            }
+        case "^":
+            position += 1
+            let assertion: SyntaxTree.Assertion = flags.contains(.anchorsMatchLines) ? .startOfLine(unixLines: flags.contains(.useUnixLineSeparators)) : .startOfText
+            return tree.add(.assertion(assertion), span: span(from: start))
+        case "$":
+            position += 1
+            let unixLines = flags.contains(.useUnixLineSeparators)
+            let assertion: SyntaxTree.Assertion = flags.contains(.anchorsMatchLines) ? .endOfLine(unixLines: unixLines) : .endOfTextOrBeforeFinalTerminator(unixLines: unixLines)
+            return tree.add(.assertion(assertion), span: span(from: start))
+        case "\\":
+            return try parseEscape()
+        case "*", "+", "?", "{":
+            throw error(.REGEX_RULE_SYNTAX, at: position)
+        default:
+            position += 1
+            return literal(scalar.value, from: start)
+        }
+    }
+
+    // MARK: - Groups
+
+    private mutating func parseGroupName() throws -> String {
+        var name = ""
+        while let scalar = peek(), scalar.isASCIIAlphanumeric {
+            guard !name.isEmpty || scalar.decimalValue == nil else { break }
+            name.unicodeScalars.append(scalar)
+            position += 1
+        }
+        guard !name.isEmpty, consume(">") else {
+            throw error(.REGEX_INVALID_CAPTURE_GROUP_NAME, at: position)
+        }
+        return name
+    }
+
+    /// Parses the flags of `(?ismwx-ismwx)` or `(?ismwx-ismwx:`, returning
+    /// whether they begin a group.
+    private mutating func parseFlags() throws -> Bool {
+        var isNegated = false
+        while let scalar = peek() {
+            let flag: SyntaxTree.Flags
+            switch scalar {
+            case "i": flag = .caseInsensitive
+            case "s": flag = .dotMatchesLineSeparators
+            case "m": flag = .anchorsMatchLines
+            case "d": flag = .useUnixLineSeparators
+            case "w": flag = .useUnicodeWordBoundaries
+            case "x": flag = .allowCommentsAndWhitespace
+            case "-" where !isNegated:
+                isNegated = true
+                position += 1
+                continue
+            case ")":
+                position += 1
+                return false
+            case ":":
+                position += 1
+                return true
+            default:
+                throw error(.REGEX_RULE_SYNTAX, at: position)
+            }
+            if isNegated {
+                flags.remove(flag)
+            } else {
+                flags.insert(flag)
+            }
+            position += 1
+        }
+        throw error(.REGEX_MISMATCHED_PAREN, at: position)
+    }
+
+    private mutating func parseGroup() throws -> SyntaxTree.NodeIndex? {
+        let start = position
+        let outerFlags = flags
+        position += 1
+
+        enum Kind {
+            case capture(Int32)
+            case nonCapturing
+            case lookaround(SyntaxTree.Lookaround)
+            case atomic
+        }
+
+        let kind: Kind
+        if consume("?") {
+            if consume(":") {
+                kind = .nonCapturing
+            } else if consume("=") {
+                kind = .lookaround(.ahead)
+            } else if consume("!") {
+                kind = .lookaround(.negativeAhead)
+            } else if peek() == "<" && peek(1) == "=" {
+                position += 2
+                kind = .lookaround(.behind)
+            } else if peek() == "<" && peek(1) == "!" {
+                position += 2
+                kind = .lookaround(.negativeBehind)
+            } else if consume("<") {
+                let name = try parseGroupName()
+                guard tree.captureNames[name] == nil else {
+                    throw error(.REGEX_INVALID_CAPTURE_GROUP_NAME, at: start)
+                }
+                tree.captureCount += 1
+                tree.captureNames[name] = tree.captureCount
+                kind = .capture(Int32(tree.captureCount))
+            } else if consume(">") {
+                kind = .atomic
+            } else if consume("#") {
+                while let scalar = peek(), scalar != ")" {
+                    position += 1
+                }
+                guard consume(")") else {
+                    throw error(.REGEX_MISMATCHED_PAREN, at: start)
+                }
+                return nil
+            } else if try parseFlags() {
+                kind = .nonCapturing
+            } else {
+                // The flags apply to the rest of the enclosing group.
+                return nil
+            }
+        } else {
+            tree.captureCount += 1
+            kind = .capture(Int32(tree.captureCount))
+        }
+
+        let body = try parseAlternation()
+        guard consume(")") else {
+            throw error(.REGEX_MISMATCHED_PAREN, at: start)
+        }
+        flags = outerFlags
+
+        switch kind {
+        case .capture(let number):
+            return tree.add(.capture(number, body), span: span(from: start))
+        case .nonCapturing:
+            return body
+        case .lookaround(let lookaround):
+            switch lookaround {
+            case .ahead, .negativeAhead:
+                tree.features.insert(.lookahead)
+            case .behind, .negativeBehind:
+                tree.features.insert(.lookbehind)
+            }
+            return tree.add(.lookaround(body, lookaround), span: span(from: start))
+        case .atomic:
+            tree.features.insert(.atomicGroups)
+            return tree.add(.atomic(body), span: span(from: start))
+        }
+    }
+
+    // MARK: - Escapes
+
+    /// Parses the code point named by an escape, after the backslash.
+    private mutating func parseEscapedScalar() throws -> UInt32 {
+        let start = position - 1
+        guard let scalar = peek() else {
+            throw error(.REGEX_BAD_ESCAPE_SEQUENCE, at: start)
+        }
+        position += 1
+
+        func hexadecimal(digits: Int) throws -> UInt32 {
+            var value: UInt32 = 0
+            for _ in 0 ..< digits {
+                guard let digit = peek()?.hexadecimalValue else {
+                    throw error(.REGEX_BAD_ESCAPE_SEQUENCE, at: start)
+                }
+                value = value << 4 | digit
+                position += 1
+            }
+            return value
+        }
+
+        let value: UInt32
+        switch scalar {
+        case "a": value = 0x07
+        case "e": value = 0x1B
+        case "f": value = 0x0C
+        case "n": value = 0x0A
+        case "r": value = 0x0D
+        case "t": value = 0x09
+        case "c":
+            guard let control = peek() else {
+                throw error(.REGEX_BAD_ESCAPE_SEQUENCE, at: start)
+            }
+            position += 1
+            value = control.value & 0x1F
+        case "0":
+            var octal: UInt32 = 0
+            var digits = 0
+            while digits < 3, let digit = peek(), ("0" ... "7").contains(digit), octal * 8 + digit.value - 0x30 <= 0o377 {
+                octal = octal * 8 + digit.value - 0x30
+                digits += 1
+                position += 1
+            }
+            value = octal
+        case "x" where peek() == "{":
+            position += 1
+            var hex: UInt32 = 0
+            var digits = 0
+            while let digit = peek()?.hexadecimalValue, digits < 8 {
+                hex = hex << 4 | digit
+                digits += 1
+                position += 1
+            }
+            guard digits > 0, consume("}") else {
+                throw error(.REGEX_BAD_ESCAPE_SEQUENCE, at: start)
+            }
+            value = hex
+        case "x":
+            value = try hexadecimal(digits: 2)
+        case "u":
+            value = try hexadecimal(digits: 4)
+        case "U":
+            value = try hexadecimal(digits: 8)
+        case "N":
+            // Character names need ICU's name data; leave them to ICU.
+            throw error(.REGEX_UNIMPLEMENTED, at: start)
+        case _ where scalar.isASCIIAlphanumeric:
+            guard !options.contains(.failOnUnknownEscapes) else {
+                throw error(.REGEX_BAD_ESCAPE_SEQUENCE, at: start)
+            }
+            value = scalar.value
+        default:
+            value = scalar.value
+        }
+
+        guard value <= ScalarSet.maximum else {
+            throw error(.REGEX_BAD_ESCAPE_SEQUENCE, at: start)
+        }
+        return value
+    }
+
+    /// Parses a set-valued escape like `\d` or `\p{L}`, after the backslash,
+    /// if the next scalar starts one.
+    private mutating func parseEscapedSet() throws -> ScalarSet? {
+        let start = position - 1
+        guard let scalar = peek() else { return nil }
+
+        let set: ScalarSet
+        switch scalar {
+        case "d", "D":
+            set = .digit
+        case "w", "W":
+            set = .word
+        case "s", "S":
+            set = .whitespace
+        case "h", "H":
+            set = .horizontalWhitespace
+        case "v", "V":
+            set = .lineTerminators
+        case "p", "P":
+            position += 1
+            var name = ""
+            if consume("{") {
+                while let scalar = peek(), scalar != "}" {
+                    name.unicodeScalars.append(scalar)
+                    position += 1
+                }
+                guard consume("}") else {
+                    throw error(.REGEX_PROPERTY_SYNTAX, at: start)
+                }
+            } else if let scalar = peek() {
+                name.unicodeScalars.append(scalar)
+                position += 1
+            }
+            guard var property = ScalarSet(icuPattern: "[\\p{\(name)}]") else {
+                throw error(.REGEX_PROPERTY_SYNTAX, at: start)
+            }
+            if flags.contains(.caseInsensitive) {
+                property = property.caseClosed()
+            }
+            return scalar == "P" ? property.inverted() : property
+        default:
+            return nil
+        }
+
+        position += 1
+        let isNegated = ("A" ... "Z").contains(scalar)
+        return isNegated ? set.inverted() : set
+    }
+
+    private mutating func parseEscape() throws -> SyntaxTree.NodeIndex {
+        let start = position
+        position += 1
+
+        if let set = try parseEscapedSet() {
+            return self.set(set, from: start)
+        }
+
+        guard let scalar = peek() else {
+            throw error(.REGEX_BAD_ESCAPE_SEQUENCE, at: start)
+        }
+
+        let assertion: SyntaxTree.Assertion
+        switch scalar {
+        case "b", "B":
+            if flags.contains(.useUnicodeWordBoundaries) {
+                tree.features.insert(.unicodeWordBoundaries)
+            }
+            assertion = scalar == "b" ? .wordBoundary : .notWordBoundary
+        case "A":
+            assertion = .startOfText
+        case "z":
+            assertion = .endOfText
+        case "Z":
+            assertion = .endOfTextOrBeforeFinalTerminator(unixLines: flags.contains(.useUnixLineSeparators))
+        case "G":
+            tree.features.insert(.previousMatchAnchor)
+            assertion = .previousMatchEnd
+        case "X":
+            position += 1
+            tree.features.insert(.graphemeClusters)
+            return tree.add(.graphemeCluster, span: span(from: start))
+        case "R":
+            // (?>\r\n|\v)
+            position += 1
+            let crlf = [literal(0x0D, from: start), literal(0x0A, from: start)]
+            let (crlfStart, crlfEnd) = tree.addChildren(crlf)
+            let branches = [tree.add(.concatenation(crlfStart, crlfEnd), span: span(from: start)), set(.lineTerminators, from: start)]
+            let (branchesStart, branchesEnd) = tree.addChildren(branches)
+            let alternation = tree.add(.alternation(branchesStart, branchesEnd), span: span(from: start))
+            tree.features.insert(.atomicGroups)
+            return tree.add(.atomic(alternation), span: span(from: start))
+        case "Q":
+            position += 1
+            var items = [SyntaxTree.NodeIndex]()
+            while !isAtEnd && !(peek() == "\\" && peek(1) == "E") {
+                let literalStart = position
+                position += 1
+                items.append(literal(scalars[literalStart].value, from: literalStart))
+            }
+            if !isAtEnd {
+                position += 2
+            }
+            return concatenation(items, from: start)
+        case "k":
+            position += 1
+            guard consume("<") else {
+                throw error(.REGEX_BAD_ESCAPE_SEQUENCE, at: start)
+            }
+            let name = try parseGroupName()
+            guard let number = tree.captureNames[name] else {
+                throw error(.REGEX_INVALID_CAPTURE_GROUP_NAME, at: start)
+            }
+            tree.features.insert(.backreferences)
+            return tree.add(.backreference(Int32(number), caseInsensitive: flags.contains(.caseInsensitive)), span: span(from: start))
+        case "1" ... "9":
+            let number = parseNumber()!
+            guard Int(number) <= tree.captureCount else {
+                throw error(.REGEX_INVALID_BACK_REF, at: start)
+            }
+            tree.features.insert(.backreferences)
+            return tree.add(.backreference(number, caseInsensitive: flags.contains(.caseInsensitive)), span: span(from: start))
+        default:
+            return literal(try parseEscapedScalar(), from: start)
+        }
+
+        position += 1
+        return tree.add(.assertion(assertion), span: span(from: start))
+    }
+
+    // MARK: - Sets
+
+    private mutating func parsePOSIXSet() throws -> ScalarSet {
+        let start = position
+        var text = ""
+        while let scalar = peek() {
+            text.unicodeScalars.append(scalar)
+            position += 1
+            if scalar == "]" && text.unicodeScalars.count > 2 {
+                break
+            }
+        }
+        guard text.hasSuffix(":]"), let set = ScalarSet(icuPattern: text) else {
+            throw error(.REGEX_PROPERTY_SYNTAX, at: start)
+        }
+        return set
+    }
+
+    private mutating func parseSetEscapedSet() throws -> ScalarSet? {
+        guard peek() == "\\" else { return nil }
+        position += 1
+        if let set = try parseEscapedSet() {
+            return set
+        }
+        position -= 1
+        return nil
+    }
+
+    private mutating func parseSetScalar() throws -> UInt32 {
+        guard let scalar = peek() else {
+            throw error(.REGEX_MISSING_CLOSE_BRACKET, at: position)
+        }
+        position += 1
+        return scalar == "\\" ? try parseEscapedScalar() : scalar.value
+    }
+
+    /// Parses a bracket expression, including nested sets and the `&&`, `--`,
+    /// `&[`, and `-[` operators.
+    private mutating func parseSetExpression() throws -> ScalarSet {
+        let start = position
+        if peek(1) == ":" {
+            return try parsePOSIXSet()
+        }
+        position += 1
+
+        let isNegated = consume("^")
+        var set = ScalarSet()
+        var pendingOperator: UnicodeScalar?
+        var isFirst = true
+        while true {
+            if flags.contains(.allowCommentsAndWhitespace) {
+                while let scalar = peek(), scalar.isPatternWhitespace {
+                    position += 1
+                }
+            }
+            guard let scalar = peek() else {
+                throw error(.REGEX_MISSING_CLOSE_BRACKET, at: start)
+            }
+
+            if scalar == "]" && !isFirst {
+                position += 1
+                break
+            } else if !isFirst && (scalar == "&" || scalar == "-") && (peek(1) == scalar || peek(1) == "[") {
+                position += peek(1) == scalar ? 2 : 1
+                pendingOperator = scalar
+                continue
+            }
+
+            let operand: ScalarSet
+            if scalar == "[" {
+                operand = try parseSetExpression()
+            } else if let escaped = try parseSetEscapedSet() {
+                operand = escaped
+            } else {
+                let lower = try parseSetScalar()
+                if peek() == "-", let next = peek(1), next != "]", next != "-", next != "[" {
+                    let rangeStart = position
+                    position += 1
+                    let upper = try parseSetScalar()
+                    guard lower <= upper else {
+                        throw error(.REGEX_INVALID_RANGE, at: rangeStart)
+                    }
+                    operand = ScalarSet([lower ... upper])
+                } else {
+                    operand = ScalarSet(lower)
+                }
+            }
+            isFirst = false
+
+            if pendingOperator == "&" {
+                set = set.intersection(operand)
+            } else if pendingOperator == "-" {
+                set = set.subtracting(operand)
+            } else {
+                set = set.union(operand)
+            }
+            pendingOperator = nil
+        }
+
+        if flags.contains(.caseInsensitive) {
+            set = set.caseClosed()
+        }
+        return isNegated ? set.inverted() : set
+    }
+
+}
@@ -0,0 +1,469 @@
+//
+//  PikeVM.swift
+//  Irregular
+//
+
+/// Text the DFA and Pike VM can search: a sequence of elements, each of one
+/// or more offsets, and the assertions that hold between them.
+///
+/// The elements are code points of UTF-16 text, or the bytes of UTF-8 text
+/// for programs translated with `Program(utf8:)`.
+protocol SearchText {
+
+    /// Where a match may begin and end.
+    var start: Int { get }
+    var end: Int { get }
+
+    /// Where `^` and `\A` see the start of the text.
+    var anchorStart: Int { get }
+
+    /// Returns the element at `i` and how many offsets it spans.
+    func scalar(at i: Int, limit: Int) -> (value: UInt32, width: Int)
+
+    /// Returns the element that ends at `i`.
+    func scalar(before i: Int, limit: Int) -> (value: UInt32, width: Int)
+
+    func holds(_ assertion: SyntaxTree.Assertion, at i: Int) -> Bool
+
+    /// Returns the same text with matches confined to `start ..< end`, but
+    /// assertions still seeing the original bounds.
+    func bounded(from start: Int, to end: Int) -> Self
+
+}
+
+/// UTF-16 text for the native engines, with the bounds ICU would use.
+struct SearchInput: SearchText {
+
+    let units: UnsafeBufferPointer<UInt16>
+
+    /// Where a match may begin and end.
+    let start: Int
+    let end: Int
+
+    /// Where `^`, `$`, `\A`, and `\z` see the edges of the text: the search
+    /// bounds with anchoring bounds, or else the whole text.
+    let anchorStart: Int
+    let anchorEnd: Int
+
+    /// How far assertions like `\b` may look: the whole text with
+    /// transparent bounds, or else the search bounds.
+    let lookStart: Int
+    let lookEnd: Int
+
+    init(units: UnsafeBufferPointer<UInt16>, start: Int, end: Int, options: RegularExpression.MatchingOptions) {
+        self.units = units
+        self.start = start
+        self.end = end
+        let anchoring = !options.contains(.withoutAnchoringBounds)
+        self.anchorStart = anchoring ? start : 0
+        self.anchorEnd = anchoring ? end : units.count
+        let transparent = options.contains(.withTransparentBounds)
+        self.lookStart = transparent ? 0 : start
+        self.lookEnd = transparent ? units.count : end
+    }
+
+    private init(_ other: SearchInput, start: Int, end: Int) {
+        self.units = other.units
+        self.start = start
+        self.end = end
+        self.anchorStart = other.anchorStart
+        self.anchorEnd = other.anchorEnd
+        self.lookStart = other.lookStart
+        self.lookEnd = other.lookEnd
+    }
+
+    /// Returns the same input with matches confined to `start ..< end`, but
+    /// assertions still seeing the original bounds.
+    func bounded(from start: Int, to end: Int) -> SearchInput {
+        return SearchInput(self, start: start, end: end)
+    }
+
+    /// Decodes the code point at `i`; an unpaired surrogate is its own code
+    /// point.
+    func scalar(at i: Int, limit: Int) -> (value: UInt32, width: Int) {
+        let unit = units[i]
+        if unit & 0xFC00 == 0xD800 && i + 1 < limit && units[i + 1] & 0xFC00 == 0xDC00 {
+            return (0x10000 + (UInt32(unit & 0x3FF) << 10 | UInt32(units[i + 1] & 0x3FF)), 2)
+        }
+        return (UInt32(unit), 1)
+    }
+
+    /// Decodes the code point that ends at `i`.
+    func scalar(before i: Int, limit: Int) -> (value: UInt32, width: Int) {
+        let unit = units[i - 1]
+        if unit & 0xFC00 == 0xDC00 && i - 2 >= limit && units[i - 2] & 0xFC00 == 0xD800 {
+            return (0x10000 + (UInt32(units[i - 2] & 0x3FF) << 10 | UInt32(unit & 0x3FF)), 2)
+        }
+        return (UInt32(unit), 1)
+    }
+
+    private func isLineTerminator(_ unit: UInt16) -> Bool {
+        switch unit {
+        case 0x0A ... 0x0D, 0x85, 0x2028, 0x2029:
+            return true
+        default:
+            return false
+        }
+    }
+
+    /// Whether `\b` matches at `i`, as ICU defines it: the word-ness of the
+    /// next character differs from that of the previous one, skipping back
+    /// over combining marks and format characters; and never before one.
+    private func isWordBoundary(at i: Int) -> Bool {
+        var isWordAfter = false
+        if i < lookEnd {
+            let after = scalar(at: i, limit: lookEnd).value
+            if ScalarSet.wordBoundaryTransparent.contains(after) {
+                return false
+            }
+            isWordAfter = ScalarSet.word.contains(after)
+        }
+
+        var isWordBefore = false
+        var position = i
+        while position > lookStart {
+            let (before, width) = scalar(before: position, limit: lookStart)
+            position -= width
+            if !ScalarSet.wordBoundaryTransparent.contains(before) {
+                isWordBefore = ScalarSet.word.contains(before)
+                break
+            }
+        }
+
+        return isWordAfter != isWordBefore
+    }
+
+    func holds(_ assertion: SyntaxTree.Assertion, at i: Int) -> Bool {
+        switch assertion {
+        case .startOfText:
+            return i == anchorStart
+        case .endOfText:
+            return i == anchorEnd
+        case .endOfTextOrBeforeFinalTerminator(let unixLines):
+            if i == anchorEnd {
+                return true
+            } else if unixLines {
+                return i + 1 == anchorEnd && units[i] == 0x0A
+            } else {
+                // Like ICU, not between the `\r` and `\n` of a final CRLF.
+                return (i + 1 == anchorEnd && isLineTerminator(units[i]) && !(units[i] == 0x0A && i > lookStart && units[i - 1] == 0x0D)) ||
+                    (i + 2 == anchorEnd && units[i] == 0x0D && units[i + 1] == 0x0A)
+            }
+        case .startOfLine(let unixLines):
+            if i == anchorStart {
+                return true
+            } else if i >= anchorEnd {
+                // ICU's multiline `^` doesn't match after a final terminator.
+                return false
+            }
+            let before = units[i - 1]
+            if unixLines {
+                return before == 0x0A
+            }
+            return isLineTerminator(before) && !(before == 0x0D && units[i] == 0x0A)
+        case .endOfLine(let unixLines):
+            if i >= anchorEnd {
+                return true
+            }
+            let after = units[i]
+            if unixLines {
+                return after == 0x0A
+            }
+            return isLineTerminator(after) && !(after == 0x0A && i > lookStart && units[i - 1] == 0x0D)
+        case .wordBoundary:
+            return isWordBoundary(at: i)
+        case .notWordBoundary:
+            return !isWordBoundary(at: i)
+        case .previousMatchEnd:
+            preconditionFailure("\\G is not compiled for the native engines")
+        }
+    }
+
+}
+
+/// A Thompson NFA simulation that follows every path through a `Program` at
+/// once, like RE2's Pike VM.
+///
+/// Threads are kept in priority order so the match is the one ICU's
+/// backtracker would find first, and a search takes time proportional to the
+/// length of the text times the size of the program, whatever the pattern.
+final class PikeVM {
+
+    /// Threads at one position, as a sparse set of instruction indices in
+    /// priority order, with each thread's capture slots.
+    private final class ThreadList {
+        var sparse: ContiguousArray<Int32>
+        var dense: ContiguousArray<Int32>
+        var count = 0
+        var slots: ContiguousArray<Int>
+
+        init(programSize: Int, slotCount: Int) {
+            sparse = ContiguousArray(repeating: 0, count: programSize)
+            dense = ContiguousArray(repeating: 0, count: programSize)
+            slots = ContiguousArray(repeating: -1, count: programSize * slotCount)
+        }
+
+        func contains(_ pc: Int32) -> Bool {
+            let index = Int(sparse[Int(pc)])
+            return index < count && dense[index] == pc
+        }
+
+        func insert(_ pc: Int32) {
+            sparse[Int(pc)] = Int32(count)
+            dense[count] = pc
+            count += 1
+        }
+    }
+
+    private enum Frame {
+        case explore(Int32)
+        case restore(Int32, Int)
+    }
+
+    /// The monitor is consulted once per this many positions.
+    private static let checkInterval = 256
+
+    let program: Program
+    private var current: ThreadList
+    private var next: ThreadList
+    private var stack = [Frame]()
+    private var scratch: ContiguousArray<Int>
+
+    /// Thread steps taken, for `MatchLimits.maximumSteps`, which counts in
+    /// units of ten thousand like ICU's match callback.
+    private var work = 0
+
+    init(program: Program) {
+        self.program = program
+        self.current = ThreadList(programSize: program.instructions.count, slotCount: program.slotCount)
+        self.next = ThreadList(programSize: program.instructions.count, slotCount: program.slotCount)
+        self.scratch = ContiguousArray(repeating: -1, count: program.slotCount)
+    }
+
+    /// Adds the thread at `pc` and everything reachable from it without
+    /// consuming input to `list`, in priority order, with `scratch` as its
+    /// capture slots.
+    private func addThread<Input: SearchText>(to list: ThreadList, at pc: Int32, position: Int, input: Input) {
+        let slotCount = program.slotCount
+        stack.append(.explore(pc))
+        while let frame = stack.popLast() {
+            switch frame {
+            case let .restore(slot, value):
+                scratch[Int(slot)] = value
+            case .explore(var pc):
+                explore: while !list.contains(pc) {
+                    list.insert(pc)
+                    switch program.instructions[Int(pc)] {
+                    case .jump(let target):
+                        pc = target
+                    case let .split(preferred, alternative):
+                        stack.append(.explore(alternative))
+                        pc = preferred
+                    case .save(let slot):
+                        stack.append(.restore(slot, scratch[Int(slot)]))
+                        scratch[Int(slot)] = position
+                        pc += 1
+                    case .assertion(let assertion):
+                        guard input.holds(assertion, at: position) else { break explore }
+                        pc += 1
+                    case .scalar, .set, .match:
+                        let base = Int(pc) * slotCount
+                        for i in 0 ..< slotCount {
+                            list.slots[base + i] = scratch[i]
+                        }
+                        break explore
+                    }
+                }
+            }
+        }
+    }
+
+    /// Returns the capture slots of the first match that begins at or after
+    /// `start`, or exactly at `start` if `anchored`.
+    ///
+    /// Returns `nil` without a match if `monitor` asks to stop, or to yield
+    /// where no thread is running, so nothing is lost by searching again
+    /// from its `suspendedIndex`.
+    func search<Input: SearchText>(_ input: Input, from start: Int, anchored: Bool, monitor: SearchMonitor?) -> ContiguousArray<Int>? {
+        let slotCount = program.slotCount
+        var matched: ContiguousArray<Int>?
+        var position = start
+        var positionsScanned = 0
+        current.count = 0
+        work = 0
+
+        while true {
+            let canStart = anchored ? position == start : (!program.isAnchoredAtStart || position == input.anchorStart)
+            if matched == nil && canStart {
+                for i in 0 ..< slotCount {
+                    scratch[i] = -1
+                }
+                addThread(to: current, at: 0, position: position, input: input)
+            }
+
+            if current.count == 0 && (matched != nil || anchored || program.isAnchoredAtStart && position > input.anchorStart) {
+                break
+            }
+
+            let hasScalar = position < input.end
+            let (scalar, width) = hasScalar ? input.scalar(at: position, limit: input.end) : (0, 0)
+            next.count = 0
+            work += current.count
+
+            threads: for i in 0 ..< current.count {
+                let pc = current.dense[i]
+                let matches: Bool
+                switch program.instructions[Int(pc)] {
+                case .scalar(let expected):
+                    matches = hasScalar && scalar == expected
+                case .set(let index):
+                    matches = hasScalar && program.sets[Int(index)].contains(scalar)
+                case .match:
+                    let base = Int(pc) * slotCount
+                    matched = ContiguousArray(current.slots[base ..< base + slotCount])
+                    // Lower-priority threads can't produce the match ICU would.
+                    break threads
+                default:
+                    matches = false
+                }
+
+                if matches {
+                    let base = Int(pc) * slotCount
+                    for j in 0 ..< slotCount {
+                        scratch[j] = current.slots[base + j]
+                    }
+                    addThread(to: next, at: pc + 1, position: position + width, input: input)
+                }
+            }
+
+            guard hasScalar else { break }
+            swap(&current, &next)
+            position += width
+
+            positionsScanned += 1
+            if let monitor = monitor, positionsScanned % PikeVM.checkInterval == 0 {
+                guard monitor.shouldContinue(steps: work / 10_000) else { return nil }
+                if matched == nil && current.count == 0 && !anchored && !monitor.shouldContinueScanning(at: position, positions: PikeVM.checkInterval) {
+                    return nil
+                }
+            }
+        }
+
+        return matched
+    }
+
+}
+
+/// Iteration state for matching with the native engines, without involving
+/// ICU.
+///
+/// Where DFAs can find the exact span of a match, capture groups are only
+/// resolved over that span, and not at all if they aren't needed. Anchored
+/// matches of one-pass patterns resolve them without the Pike VM, and so does
+/// the bounded backtracker on short text. Patterns of a fixed sequence of
+/// characters are matched by comparing each in turn, with none of these.
+final class NativeScan {
+
+    private let vm: PikeVM
+    private let backtracker: BoundedBacktracker?
+    private let searcher: DFASearcher?
+    private let onePass: OnePass?
+    private let fixedSequence: FixedSequence?
+    private let needsCaptures: Bool
+    private let units: ContiguousArray<UInt16>
+    private let options: RegularExpression.MatchingOptions
+    private let start: Int
+    private let end: Int
+    private var position: Int
+    private var isFinished = false
+
+    init(program: Program, searcher: DFASearcher?, onePass: OnePass? = nil, fixedSequence: FixedSequence? = nil, backtrackingMemoryBudget: Int = 0, needsCaptures: Bool = true, units: ContiguousArray<UInt16>, start: Int, end: Int, options: RegularExpression.MatchingOptions) {
+        self.vm = PikeVM(program: program)
+        self.backtracker = backtrackingMemoryBudget > 0 ? BoundedBacktracker(program: program, memoryBudget: backtrackingMemoryBudget) : nil
+        self.searcher = searcher
+        self.onePass = onePass
+        self.fixedSequence = fixedSequence
+        self.needsCaptures = needsCaptures && program.captureCount > 0
+        self.units = units
+        self.options = options
+        self.start = start
+        self.end = end
+        self.position = start
+    }
+
+    /// Runs the bounded backtracker if the search fits its budget, or else
+    /// the Pike VM.
+    private func backtrackOrSimulate(_ input: SearchInput, from start: Int, anchored: Bool, monitor: SearchMonitor?) -> ContiguousArray<Int>? {
+        if let backtracker = backtracker, backtracker.fits(input, from: start) {
+            return backtracker.search(input, from: start, anchored: anchored, monitor: monitor)
+        }
+        return vm.search(input, from: start, anchored: anchored, monitor: monitor)
+    }
+
+    private func search(_ input: SearchInput, anchored: Bool, monitor: SearchMonitor?) -> ContiguousArray<Int>? {
+        if let fixedSequence = fixedSequence {
+            return fixedSequence.match(input, from: position, anchored: anchored, needsCaptures: needsCaptures, monitor: monitor)
+        }
+
+        if let searcher = searcher {
+            let innerSpan = anchored || !searcher.usesInnerLiteral ? nil : searcher.innerLiteral?.span(in: input, from: position, monitor: monitor)
+            switch innerSpan ?? searcher.span(in: input, from: position, anchored: anchored, monitor: monitor) {
+            case .found(let span):
+                guard needsCaptures else { return [span.lowerBound, span.upperBound] }
+                let spanInput = input.bounded(from: span.lowerBound, to: span.upperBound)
+                let slots = onePass.flatMap { $0.match(spanInput, at: span.lowerBound) } ?? backtrackOrSimulate(spanInput, from: span.lowerBound, anchored: true, monitor: monitor)
+                if let slots = slots, slots[1] == span.upperBound {
+                    return slots
+                }
+            case .none:
+                return nil
+            case .gaveUp:
+                break
+            }
+        }
+
+        if let onePass = onePass, anchored || vm.program.isAnchoredAtStart {
+            guard anchored || position == input.anchorStart else { return nil }
+            return onePass.match(input, at: position)
+        }
+        return backtrackOrSimulate(input, from: position, anchored: anchored, monitor: monitor)
+    }
+
+    /// Returns the UTF-16 offsets of the next match and its capture groups,
+    /// in pairs, with `-1` for groups that didn't participate.
+    ///
+    /// Like ICU, the search after an empty match begins one code point later,
+    /// and an anchored search matches at most once.
+    ///
+    /// Returns `nil` without a match if `monitor` suspends the search, and
+    /// the next call picks up where it stopped.
+    func findNext(monitor: SearchMonitor?) -> ContiguousArray<Int>? {
+        guard !isFinished, monitor?.interruption == nil else { return nil }
+        let isAnchored = options.contains(.anchored)
+        let slots = units.withUnsafeBufferPointer { (buffer) -> ContiguousArray<Int>? in
+            let input = SearchInput(units: buffer, start: start, end: end, options: options)
+            guard let slots = search(input, anchored: isAnchored, monitor: monitor) else {
+                if let resumeIndex = monitor?.suspendedIndex {
+                    position = Int(resumeIndex)
+                }
+                return nil
+            }
+            if slots[0] == slots[1] {
+                if slots[1] >= end {
+                    isFinished = true
+                } else {
+                    position = slots[1] + input.scalar(at: slots[1], limit: end).width
+                }
+            } else {
+                position = slots[1]
+            }
+            return slots
+        }
+
+        if (slots == nil && monitor?.suspendedIndex == nil) || isAnchored {
+            isFinished = true
+        }
+        return slots
+    }
+
+}
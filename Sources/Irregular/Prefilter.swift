@@ -0,0 +1,221 @@
+//
+//  Prefilter.swift
+//  Irregular
+//
+
+import CUnicode
+
+/// A literal every match must begin with, found by a quick lexical pass over
+/// the pattern.
+///
+/// The analysis is deliberately conservative: anything it doesn't fully
+/// understand ends the prefix, and anything that lets a match start without
+/// the prefix (top-level alternation, look-behind, `\G`, free-spacing mode)
+/// means there is no prefix at all.
+enum LiteralPrefix {
+
+    private static let metacharacters = Set("\\.^$|()[]{}*+?".unicodeScalars)
+
+    private static func escapedLiteral(_ scalar: UnicodeScalar) -> UnicodeScalar? {
+        switch scalar {
+        case "t": return "\t"
+        case "n": return "\n"
+        case "r": return "\r"
+        case "f": return "\u{0C}"
+        case "a": return "\u{07}"
+        case "e": return "\u{1B}"
+        case _ where scalar.isASCII && !("a" ... "z").contains(scalar) && !("A" ... "Z").contains(scalar) && !("0" ... "9").contains(scalar):
+            return scalar
+        default:
+            return nil
+        }
+    }
+
+    /// Whether a match could begin somewhere other than at the first literal:
+    /// an unparenthesized `|`, or a construct that inspects text before the
+    /// match start.
+    private static func hasUnprefixedStart(_ scalars: [UnicodeScalar]) -> Bool {
+        var depth = 0
+        var classDepth = 0
+        var i = 0
+        while i < scalars.count {
+            switch scalars[i] {
+            case "\\":
+                if i + 1 < scalars.count && (scalars[i + 1] == "G" || scalars[i + 1] == "Q") {
+                    return true
+                }
+                i += 1
+            case "[":
+                classDepth += 1
+            case "]" where classDepth > 0:
+                classDepth -= 1
+            case "(" where classDepth == 0:
+                if i + 3 < scalars.count && scalars[i + 1] == "?" && scalars[i + 2] == "<" && (scalars[i + 3] == "=" || scalars[i + 3] == "!") {
+                    return true
+                }
+                depth += 1
+            case ")" where classDepth == 0:
+                depth -= 1
+            case "|" where classDepth == 0 && depth == 0:
+                return true
+            default:
+                break
+            }
+            i += 1
+        }
+        return false
+    }
+
+    /// Returns the literal scalars every match of `pattern` begins with, ASCII
+    /// lowercased if the pattern is case-insensitive, and whether they are
+    /// the entire pattern.
+    static func scalars(of pattern: String, options: RegularExpression.Options) -> (prefix: [UnicodeScalar], isWholePattern: Bool) {
+        let scalars = Array(pattern.unicodeScalars)
+        let isLiteral = options.contains(.ignoreMetacharacters)
+        guard isLiteral || (!options.contains(.allowCommentsAndWhitespace) && !hasUnprefixedStart(scalars)) else {
+            return ([], false)
+        }
+
+        var prefix = [UnicodeScalar]()
+        var i = 0
+        while i < scalars.count {
+            var literal = scalars[i]
+            if isLiteral {
+                i += 1
+            } else if literal == "\\" {
+                guard i + 1 < scalars.count, let escaped = escapedLiteral(scalars[i + 1]) else { break }
+                literal = escaped
+                i += 2
+            } else if metacharacters.contains(literal) {
+                break
+            } else {
+                i += 1
+            }
+
+            if !isLiteral && i < scalars.count && (scalars[i] == "?" || scalars[i] == "*" || scalars[i] == "{") {
+                // The literal is optional or repeated a variable number of times.
+                return (prefix, false)
+            }
+
+            if options.contains(.caseInsensitive) {
+                // The searcher only folds ASCII letters, so a literal that is
+                // also equal to something else, like `k` and the Kelvin sign,
+                // ends the prefix.
+                guard literal.isASCII && CaseFolding.shared.hasOnlyASCIIEquivalents(literal.value) else { return (prefix, false) }
+                if ("A" ... "Z").contains(literal) {
+                    literal = UnicodeScalar(literal.value | 0x20)!
+                }
+            }
+            prefix.append(literal)
+
+            if !isLiteral && i < scalars.count && scalars[i] == "+" {
+                return (prefix, false)
+            }
+        }
+        return (prefix, i == scalars.count)
+    }
+
+    /// Returns a searcher for the literal prefix of `pattern`, if it has one,
+    /// and whether the pattern is nothing but that literal.
+    static func searcher(for pattern: String, options: RegularExpression.Options) -> (searcher: LiteralSearcher, isWholePattern: Bool)? {
+        let (prefix, isWholePattern) = scalars(of: pattern, options: options)
+        guard !prefix.isEmpty else { return nil }
+        var units = [UInt16]()
+        for scalar in prefix {
+            UTF16.encode(scalar) { units.append($0) }
+        }
+        return (LiteralSearcher(needle: units, caseInsensitive: options.contains(.caseInsensitive)), isWholePattern)
+    }
+
+}
+
+/// Iteration state for matching a pattern that is only a literal, without
+/// involving ICU.
+final class LiteralScan {
+
+    /// With a monitor, the text is searched this many start positions at a
+    /// time, checking it in between.
+    private static let chunkLength = 4096
+
+    private let searcher: LiteralSearcher
+    private let units: ContiguousArray<UInt16>
+    private var position: Int
+    private let end: Int
+    private let isAnchored: Bool
+
+    init(searcher: LiteralSearcher, units: ContiguousArray<UInt16>, start: Int, end: Int, anchored: Bool) {
+        self.searcher = searcher
+        self.units = units
+        self.position = start
+        self.end = end
+        self.isAnchored = anchored
+    }
+
+    /// Returns the UTF-16 offsets of the next occurrence.
+    ///
+    /// Returns `nil` if `monitor` asks to stop or to yield, and the next
+    /// call picks up where it stopped.
+    func findNext(monitor: SearchMonitor?) -> Range<Int>? {
+        guard monitor?.interruption == nil else { return nil }
+        let length = searcher.needle.count
+        while true {
+            let chunkEnd = monitor == nil ? end : position + LiteralScan.chunkLength + length - 1
+            let limit = min(isAnchored ? position + length : chunkEnd, end)
+            if let start = units.withUnsafeBufferPointer({ searcher.firstOccurrence(in: $0, from: position, to: limit) }) {
+                position = isAnchored ? end : start + length
+                return start ..< start + length
+            }
+            guard !isAnchored, limit < end, let monitor = monitor else {
+                position = end
+                return nil
+            }
+
+            position = limit - length + 1
+            guard monitor.shouldContinue(steps: 0), monitor.shouldContinueScanning(at: position, positions: LiteralScan.chunkLength) else { return nil }
+        }
+    }
+
+}
+
+/// Iteration state for finding matches by searching for a literal prefix,
+/// then asking ICU to match only where it occurs.
+final class PrefilterScan {
+
+    private let searcher: LiteralSearcher
+    private let units: ContiguousArray<UInt16>
+    private var position: Int
+    private let end: Int
+
+    init(searcher: LiteralSearcher, units: ContiguousArray<UInt16>, start: Int, end: Int) {
+        self.searcher = searcher
+        self.units = units
+        self.position = start
+        self.end = end
+    }
+
+    /// Finds the next match. Each occurrence of the prefix becomes the start
+    /// of the region for an anchored ICU match; the first one that matches is
+    /// the leftmost match.
+    func findNext(with handle: UnsafeMutablePointer<URegularExpression>, monitor: SearchMonitor?, status: inout UErrorCode) -> Bool {
+        return units.withUnsafeBufferPointer { (buffer) -> Bool in
+            while let candidate = searcher.firstOccurrence(in: buffer, from: position, to: end) {
+                handle.pointee.setRegion(start: Int64(candidate), end: Int64(end), status: &status)
+                let found = handle.pointee.isLooking(atIndex: -1, status: &status) != 0
+                guard status.isSuccess, monitor?.interruption == nil else {
+                    return false
+                }
+
+                if found {
+                    let matchEnd = Int(handle.pointee.endIndex(forGroupAtIndex: 0, status: &status))
+                    position = max(matchEnd, candidate + 1)
+                    return true
+                }
+                position = candidate + 1
+            }
+
+            position = end
+            return false
+        }
+    }
+
+}
@@ -0,0 +1,381 @@
+//
+//  Program.swift
+//  Irregular
+//
+
+/// A pattern compiled to instructions for the native engines.
+///
+/// Only patterns that can be matched without backtracking compile: no
+/// backreferences, look-around, atomic groups or possessive quantifiers,
+/// `\G`, `\X`, or Unicode word boundaries.
+struct Program {
+
+    enum Instruction {
+        /// Consumes one code point equal to the operand.
+        case scalar(UInt32)
+        /// Consumes one code point in the operand's set.
+        case set(Int32)
+        /// Continues at both targets, preferring the first.
+        case split(Int32, Int32)
+        case jump(Int32)
+        /// Records the current position in a capture slot.
+        case save(Int32)
+        case assertion(SyntaxTree.Assertion)
+        case match
+    }
+
+    /// Counted repetitions are expanded, so a pattern like `(a{1000}){1000}`
+    /// would be enormous; anything larger than this is left to ICU.
+    static let maximumSize = 1 << 16
+
+    private static let unsupportedFeatures: SyntaxTree.Features = [.backreferences, .lookahead, .lookbehind, .atomicGroups, .previousMatchAnchor, .graphemeClusters, .unicodeWordBoundaries, .fullCaseFolding, .dotMatchingCRLF]
+
+    private(set) var instructions = ContiguousArray<Instruction>()
+    private(set) var sets = [ScalarSet]()
+    let captureCount: Int
+
+    /// Whether every match must begin where `\A` matches.
+    let isAnchoredAtStart: Bool
+
+    /// The assertion every match must end at, if it holds only at the end of
+    /// the text: `\z`, or `\Z` and `$` without `anchorsMatchLines`.
+    let endAnchor: SyntaxTree.Assertion?
+
+    /// Whether the program matches the pattern backward, for finding where a
+    /// match starts from where it ends.
+    let isReversed: Bool
+
+    /// Whether the program consumes UTF-8 bytes rather than code points, so
+    /// its scalars and sets are byte values.
+    let isUTF8: Bool
+
+    /// The number of capture slots: a start and end for the whole match and
+    /// each capture group.
+    var slotCount: Int {
+        return 2 * (captureCount + 1)
+    }
+
+    init?(_ tree: SyntaxTree, reversed: Bool = false) {
+        guard tree.features.isDisjoint(with: Program.unsupportedFeatures) else { return nil }
+        self.captureCount = tree.captureCount
+        self.isAnchoredAtStart = !reversed && Program.startsWithTextAnchor(tree, tree.root)
+        self.endAnchor = reversed ? nil : Program.endTextAnchor(tree, tree.root)
+        self.isReversed = reversed
+        self.isUTF8 = false
+
+        emit(.save(reversed ? 1 : 0))
+        guard compile(tree, tree.root) else { return nil }
+        emit(.save(reversed ? 0 : 1))
+        emit(.match)
+    }
+
+    private static func startsWithTextAnchor(_ tree: SyntaxTree, _ node: SyntaxTree.NodeIndex) -> Bool {
+        switch tree[node] {
+        case .assertion(.startOfText):
+            return true
+        case .capture(_, let body):
+            return startsWithTextAnchor(tree, body)
+        case .concatenation(let start, let end):
+            return startsWithTextAnchor(tree, tree.children(from: start, to: end).first!)
+        case .alternation(let start, let end):
+            return !tree.children(from: start, to: end).contains { !startsWithTextAnchor(tree, $0) }
+        default:
+            return false
+        }
+    }
+
+    private static func endTextAnchor(_ tree: SyntaxTree, _ node: SyntaxTree.NodeIndex) -> SyntaxTree.Assertion? {
+        switch tree[node] {
+        case .assertion(let assertion):
+            switch assertion {
+            case .endOfText, .endOfTextOrBeforeFinalTerminator:
+                return assertion
+            default:
+                return nil
+            }
+        case .capture(_, let body):
+            return endTextAnchor(tree, body)
+        case .concatenation(let start, let end):
+            return tree.children(from: start, to: end).last.flatMap { endTextAnchor(tree, $0) }
+        case .alternation(let start, let end):
+            // Every branch must end at the same assertion.
+            var anchor: SyntaxTree.Assertion?
+            for branch in tree.children(from: start, to: end) {
+                guard let next = endTextAnchor(tree, branch) else { return nil }
+                switch (anchor, next) {
+                case (nil, _), (.endOfText?, .endOfText):
+                    anchor = next
+                case let (.endOfTextOrBeforeFinalTerminator(a)?, .endOfTextOrBeforeFinalTerminator(b)) where a == b:
+                    anchor = next
+                default:
+                    return nil
+                }
+            }
+            return anchor
+        default:
+            return nil
+        }
+    }
+
+    @discardableResult
+    private mutating func emit(_ instruction: Instruction) -> Int32 {
+        instructions.append(instruction)
+        return Int32(instructions.count - 1)
+    }
+
+    private var next: Int32 {
+        return Int32(instructions.count)
+    }
+
+    private mutating func emit(_ set: ScalarSet) {
+        if let scalar = set.singleScalar {
+            emit(.scalar(scalar))
+        } else if let existing = sets.index(of: set) {
+            emit(.set(Int32(existing)))
+        } else {
+            sets.append(set.compiledForLookup())
+            emit(.set(Int32(sets.count - 1)))
+        }
+    }
+
+    /// Points the second branch of the split, or the jump, at `target`.
+    private mutating func patch(_ pc: Int32, to target: Int32) {
+        switch instructions[Int(pc)] {
+        case .split(let first, _):
+            instructions[Int(pc)] = .split(first, target)
+        case .jump:
+            instructions[Int(pc)] = .jump(target)
+        default:
+            preconditionFailure("only splits and jumps are patched")
+        }
+    }
+
+    /// Whether `node` compiles to no instructions, like `(?:)` or `a{0}`, so
+    /// repeating it changes nothing.
+    private static func compilesToNothing(_ tree: SyntaxTree, _ node: SyntaxTree.NodeIndex) -> Bool {
+        switch tree[node] {
+        case .empty:
+            return true
+        case let .concatenation(start, end):
+            return !tree.children(from: start, to: end).contains { !compilesToNothing(tree, $0) }
+        case let .alternation(start, end):
+            // Only a single branch compiles without a split.
+            let branches = tree.children(from: start, to: end)
+            return branches.count == 1 && compilesToNothing(tree, branches.first!)
+        case let .repetition(body, _, max, repetition):
+            return repetition != .possessive && (max == 0 || compilesToNothing(tree, body))
+        default:
+            return false
+        }
+    }
+
+    private mutating func compile(_ tree: SyntaxTree, _ node: SyntaxTree.NodeIndex) -> Bool {
+        guard instructions.count <= Program.maximumSize else { return false }
+
+        switch tree[node] {
+        case .empty:
+            break
+        case let .literal(scalar, caseInsensitive):
+            emit(caseInsensitive ? ScalarSet(scalar).caseClosed() : ScalarSet(scalar))
+        case .set(let index):
+            emit(tree.set(at: index))
+        case .assertion(let assertion):
+            emit(.assertion(assertion))
+        case let .capture(number, body):
+            emit(.save(isReversed ? 2 * number + 1 : 2 * number))
+            guard compile(tree, body) else { return false }
+            emit(.save(isReversed ? 2 * number : 2 * number + 1))
+        case let .concatenation(start, end):
+            let children = tree.children(from: start, to: end)
+            for child in isReversed ? Array(children.reversed()) : Array(children) {
+                guard compile(tree, child) else { return false }
+            }
+        case let .alternation(start, end):
+            let branches = tree.children(from: start, to: end)
+            var exits = [Int32]()
+            for branch in branches.dropLast() {
+                let split = emit(.split(next + 1, -1))
+                guard compile(tree, branch) else { return false }
+                exits.append(emit(.jump(-1)))
+                patch(split, to: next)
+            }
+            guard compile(tree, branches.last!) else { return false }
+            for exit in exits {
+                patch(exit, to: next)
+            }
+        case let .repetition(body, min, max, repetition):
+            guard repetition != .possessive else { return false }
+            // Nothing is unrolled for a body that compiles to nothing, or
+            // `(?:){2000000000}` would take billions of steps.
+            if Program.compilesToNothing(tree, body) {
+                break
+            }
+            for _ in 0 ..< min {
+                guard compile(tree, body) else { return false }
+            }
+
+            if max < 0 {
+                let loop = emit(.split(-1, -1))
+                guard compile(tree, body) else { return false }
+                emit(.jump(loop))
+                instructions[Int(loop)] = repetition == .lazy ? .split(next, loop + 1) : .split(loop + 1, next)
+            } else if max > min {
+                var splits = [Int32]()
+                for _ in min ..< max {
+                    splits.append(emit(.split(-1, -1)))
+                    guard compile(tree, body) else { return false }
+                }
+                for split in splits {
+                    instructions[Int(split)] = repetition == .lazy ? .split(next, split + 1) : .split(split + 1, next)
+                }
+            }
+        case .lookaround, .atomic, .backreference, .graphemeCluster:
+            return false
+        }
+
+        return instructions.count <= Program.maximumSize
+    }
+
+    // MARK: - UTF-8
+
+    /// Translates `program` to consume the UTF-8 encoding of what it matches.
+    ///
+    /// Each literal becomes its bytes, and each set an automaton over the byte
+    /// sequences that encode its members, with sequences that end alike
+    /// sharing their tails: `[\u{800}-\u{FFFF}]` is a few lead byte ranges
+    /// that all lead into the same two continuation bytes. Surrogate code
+    /// points have no UTF-8 encoding and never match.
+    init?(utf8 program: Program) {
+        precondition(!program.isUTF8, "program already consumes UTF-8")
+        self.captureCount = program.captureCount
+        self.isAnchoredAtStart = program.isAnchoredAtStart
+        self.endAnchor = program.endAnchor
+        self.isReversed = program.isReversed
+        self.isUTF8 = true
+
+        // Control instructions are copied with their original targets, which
+        // are translated once every instruction has been.
+        var translated = ContiguousArray<Int32>()
+        var retargeted = [Int32]()
+        var byteSets = [UInt16: Int32]()
+        for instruction in program.instructions {
+            guard instructions.count <= Program.maximumSize else { return nil }
+            translated.append(next)
+            switch instruction {
+            case .scalar(let scalar):
+                let bytes = UTF8Sequences.encode(scalar)
+                if bytes.isEmpty {
+                    emitBytes(1, 0, byteSets: &byteSets)
+                }
+                for byte in isReversed ? Array(bytes.reversed()) : bytes {
+                    emit(.scalar(UInt32(byte)))
+                }
+            case .set(let index):
+                emitSequences(of: program.sets[Int(index)], byteSets: &byteSets)
+            case .split, .jump:
+                retargeted.append(next)
+                emit(instruction)
+            case .save, .assertion, .match:
+                emit(instruction)
+            }
+        }
+        guard instructions.count <= Program.maximumSize else { return nil }
+
+        for pc in retargeted {
+            switch instructions[Int(pc)] {
+            case let .split(preferred, alternative):
+                instructions[Int(pc)] = .split(translated[Int(preferred)], translated[Int(alternative)])
+            case .jump(let target):
+                instructions[Int(pc)] = .jump(translated[Int(target)])
+            default:
+                break
+            }
+        }
+    }
+
+    /// Emits an instruction consuming one byte in `lower ... upper`, or none
+    /// if the range is empty.
+    private mutating func emitBytes(_ lower: UInt8, _ upper: UInt8, byteSets: inout [UInt16: Int32]) {
+        if lower == upper {
+            emit(.scalar(UInt32(lower)))
+            return
+        }
+        let key = UInt16(lower) << 8 | UInt16(upper)
+        if let existing = byteSets[key] {
+            emit(.set(existing))
+        } else {
+            let index = Int32(sets.count)
+            sets.append(lower <= upper ? ScalarSet([UInt32(lower) ... UInt32(upper)]).compiledForLookup() : ScalarSet())
+            byteSets[key] = index
+            emit(.set(index))
+        }
+    }
+
+    /// Emits an alternation of the byte sequences encoding `set`, built as a
+    /// graph in which sequences with the same tail share it.
+    private mutating func emitSequences(of set: ScalarSet, byteSets: inout [UInt16: Int32]) {
+        // Each node consumes a byte range and continues at another node, or
+        // leaves the set at -1.
+        var nodes = [(range: UTF8Sequences.ByteRange, next: Int)]()
+        var nodeIndices = [UInt64: Int]()
+        var entries = [Int]()
+        var isEntry = Set<Int>()
+        for sequence in UTF8Sequences(set) {
+            var next = -1
+            for range in isReversed ? sequence : Array(sequence.reversed()) {
+                let key = UInt64(range.lower) << 56 | UInt64(range.upper) << 48 | UInt64(next + 1)
+                if let existing = nodeIndices[key] {
+                    next = existing
+                } else {
+                    nodes.append((range, next))
+                    nodeIndices[key] = nodes.count - 1
+                    next = nodes.count - 1
+                }
+            }
+            if isEntry.insert(next).inserted {
+                entries.append(next)
+            }
+        }
+
+        guard !entries.isEmpty else {
+            emitBytes(1, 0, byteSets: &byteSets)
+            return
+        }
+
+        var splits = [Int32]()
+        for _ in entries.dropLast() {
+            splits.append(emit(.split(-1, -1)))
+        }
+        let lastEntry = emit(.jump(-1))
+
+        // Emits each node followed by the one it continues at, unless that
+        // was emitted already and needs a jump.
+        var nodePCs = [Int32](repeating: -1, count: nodes.count)
+        var exits = [Int32]()
+        for entry in entries where nodePCs[entry] < 0 {
+            var node = entry
+            while true {
+                nodePCs[node] = next
+                emitBytes(nodes[node].range.lower, nodes[node].range.upper, byteSets: &byteSets)
+                let following = nodes[node].next
+                if following < 0 {
+                    exits.append(emit(.jump(-1)))
+                    break
+                } else if nodePCs[following] >= 0 {
+                    emit(.jump(nodePCs[following]))
+                    break
+                }
+                node = following
+            }
+        }
+
+        for (split, entry) in zip(splits, entries) {
+            instructions[Int(split)] = .split(nodePCs[entry], split + 1)
+        }
+        instructions[Int(lastEntry)] = .jump(nodePCs[entries.last!])
+        for exit in exits {
+            patch(exit, to: next)
+        }
+    }
+
+}
@@ -0,0 +1,332 @@
+//
+//  RegularExpressionSet.swift
+//  Irregular
+//
+
+/// Every program of a set, relocated into one instruction stream and run
+/// side by side in a single pass over the text.
+///
+/// Unlike the Pike VM, threads carry no capture slots and aren't cut when a
+/// higher-priority one matches: the only question is which programs match
+/// at all.
+struct CombinedProgram {
+
+    private(set) var instructions = ContiguousArray<Program.Instruction>()
+    private(set) var sets = [ScalarSet]()
+
+    /// Where each program starts, whether it must start where `\A` matches,
+    /// and which program each instruction belongs to.
+    private(set) var starts = [Int32]()
+    private(set) var isAnchoredAtStart = [Bool]()
+    private(set) var owners = ContiguousArray<Int32>()
+
+    /// The monitor is consulted once per this many positions.
+    private static let checkInterval = 256
+
+    init(_ programs: [Program]) {
+        for (index, program) in programs.enumerated() {
+            let offset = Int32(instructions.count)
+            let setOffset = Int32(sets.count)
+            starts.append(offset)
+            isAnchoredAtStart.append(program.isAnchoredAtStart)
+            sets.append(contentsOf: program.sets)
+            for instruction in program.instructions {
+                switch instruction {
+                case let .split(preferred, alternative):
+                    instructions.append(.split(preferred + offset, alternative + offset))
+                case .jump(let target):
+                    instructions.append(.jump(target + offset))
+                case .set(let set):
+                    instructions.append(.set(set + setOffset))
+                default:
+                    instructions.append(instruction)
+                }
+                owners.append(Int32(index))
+            }
+        }
+    }
+
+    /// Adds `pc` and everything reachable from it without consuming input.
+    private func addThread(_ pc: Int32, to list: inout SparseSet, stack: inout [Int32], position: Int, input: SearchInput) {
+        stack.append(pc)
+        while let top = stack.popLast() {
+            var pc = top
+            follow: while !list.contains(pc) {
+                list.insert(pc)
+                switch instructions[Int(pc)] {
+                case .jump(let target):
+                    pc = target
+                case let .split(preferred, alternative):
+                    stack.append(alternative)
+                    pc = preferred
+                case .save:
+                    pc += 1
+                case .assertion(let assertion):
+                    guard input.holds(assertion, at: position) else { break follow }
+                    pc += 1
+                case .scalar, .set, .match:
+                    break follow
+                }
+            }
+        }
+    }
+
+    /// Returns which of the `candidates` programs match in `input`, or `nil`
+    /// if `monitor` asks to stop. If `stopAtFirst`, only the first program
+    /// found to match is reported.
+    func matchingPrograms(in input: SearchInput, candidates: [Bool], anchored: Bool, stopAtFirst: Bool, monitor: SearchMonitor?) -> [Bool]? {
+        // Programs that aren't candidates are treated as having matched
+        // already, so they're never started, and then left out.
+        var matched = candidates.map { !$0 }
+        var remaining = candidates.filter { $0 }.count
+        var current = SparseSet(capacity: instructions.count)
+        var next = SparseSet(capacity: instructions.count)
+        var stack = [Int32]()
+        var position = input.start
+        var positionsScanned = 0
+        let hasUnanchored = isAnchoredAtStart.contains(false)
+
+        while remaining > 0 {
+            if !anchored || position == input.start {
+                for (index, start) in starts.enumerated() where !matched[index] && (!isAnchoredAtStart[index] || position == input.anchorStart) {
+                    addThread(start, to: &current, stack: &stack, position: position, input: input)
+                }
+            }
+
+            if current.count == 0 && (anchored || !hasUnanchored && position > input.anchorStart) {
+                break
+            }
+
+            let hasScalar = position < input.end
+            let (scalar, width) = hasScalar ? input.scalar(at: position, limit: input.end) : (0, 0)
+            next.removeAll()
+
+            for i in 0 ..< current.count {
+                let pc = current.dense[i]
+                let owner = Int(owners[Int(pc)])
+                guard !matched[owner] else { continue }
+                let consumes: Bool
+                switch instructions[Int(pc)] {
+                case .scalar(let expected):
+                    consumes = hasScalar && scalar == expected
+                case .set(let index):
+                    consumes = hasScalar && sets[Int(index)].contains(scalar)
+                case .match:
+                    matched[owner] = true
+                    remaining -= 1
+                    if stopAtFirst {
+                        var first = [Bool](repeating: false, count: starts.count)
+                        first[owner] = true
+                        return first
+                    }
+                    consumes = false
+                default:
+                    consumes = false
+                }
+                if consumes {
+                    addThread(pc + 1, to: &next, stack: &stack, position: position + width, input: input)
+                }
+            }
+
+            guard hasScalar else { break }
+            swap(&current, &next)
+            position += width
+
+            positionsScanned += 1
+            if let monitor = monitor, positionsScanned % CombinedProgram.checkInterval == 0, !monitor.shouldContinue(steps: positionsScanned * instructions.count / 10_000) {
+                return nil
+            }
+        }
+
+        for (index, isCandidate) in candidates.enumerated() where !isCandidate {
+            matched[index] = false
+        }
+        return matched
+    }
+
+}
+
+/// Instruction indices as a sparse set, for constant-time insertion,
+/// membership and clearing.
+struct SparseSet {
+    private var sparse: ContiguousArray<Int32>
+    private(set) var dense: ContiguousArray<Int32>
+    private(set) var count = 0
+
+    init(capacity: Int) {
+        sparse = ContiguousArray(repeating: 0, count: capacity)
+        dense = ContiguousArray(repeating: 0, count: capacity)
+    }
+
+    func contains(_ pc: Int32) -> Bool {
+        let index = Int(sparse[Int(pc)])
+        return index < count && dense[index] == pc
+    }
+
+    mutating func insert(_ pc: Int32) {
+        sparse[Int(pc)] = Int32(count)
+        dense[count] = pc
+        count += 1
+    }
+
+    mutating func removeAll() {
+        count = 0
+    }
+}
+
+extension RegularExpression {
+
+    /// Many regular expressions, matched against a string together.
+    ///
+    /// Literals that every match of a pattern must contain are taken from its
+    /// syntax, or else the literal it begins with, and all of them are found
+    /// with one scan, with bucket tables for a few literals or Aho-Corasick
+    /// for many; a pattern with literals is only run if one of them occurs.
+    /// Of those, the patterns the native engines support are combined into
+    /// one program and run in a single pass over the text, and the rest are
+    /// matched by ICU one at a time.
+    public final class Set {
+
+        /// Finds which of the patterns' literals occur.
+        private enum LiteralFilter {
+            case buckets(BucketLiteralSearcher)
+            case automaton(AhoCorasick)
+
+            func occurringLiterals(in units: UnsafeBufferPointer<UInt16>, from start: Int, to end: Int) -> [Bool] {
+                switch self {
+                case .buckets(let searcher):
+                    return searcher.occurringLiterals(in: units, from: start, to: end)
+                case .automaton(let automaton):
+                    return automaton.occurringLiterals(in: units, from: start, to: end)
+                }
+            }
+        }
+
+        public let expressions: [RegularExpression]
+
+        private let combined: CombinedProgram
+
+        /// The index in `expressions` of each program in `combined`.
+        private let combinedIndices: [Int]
+
+        /// Patterns only ICU can match.
+        private let fallbackIndices: [Int]
+
+        /// The literals of every pattern that has them, and the index in
+        /// `expressions` of the pattern each belongs to.
+        private let literalFilter: LiteralFilter?
+        private let literalOwners: [Int]
+
+        /// Whether each pattern is only run if one of its literals occurs.
+        private let isFiltered: [Bool]
+
+        public convenience init(patterns: [String], options: Options = []) throws {
+            self.init(try patterns.map { try RegularExpression(pattern: $0, options: options) })
+        }
+
+        /// - parameter literalRepresentation: How the Aho-Corasick automaton
+        ///   stores its transitions, or `nil` to choose by its size. Few enough
+        ///   literals are searched for without one.
+        init(_ expressions: [RegularExpression], literalRepresentation: AhoCorasick.Representation?) {
+            self.expressions = expressions
+
+            var programs = [Program]()
+            var combinedIndices = [Int]()
+            var fallbackIndices = [Int]()
+            var literals = [[UInt16]]()
+            var literalOwners = [Int]()
+            var isFiltered = [Bool](repeating: false, count: expressions.count)
+            for (index, expression) in expressions.enumerated() {
+                if let program = expression.program {
+                    programs.append(program)
+                    combinedIndices.append(index)
+                } else {
+                    fallbackIndices.append(index)
+                }
+
+                let required = expression.syntax?.requiredLiterals ?? expression.prefilter.flatMap { $0.isCaseInsensitive ? nil : [$0.needle] }
+                if let required = required {
+                    isFiltered[index] = true
+                    literals.append(contentsOf: required)
+                    literalOwners.append(contentsOf: repeatElement(index, count: required.count))
+                }
+            }
+
+            self.combined = CombinedProgram(programs)
+            self.combinedIndices = combinedIndices
+            self.fallbackIndices = fallbackIndices
+            if literals.isEmpty {
+                self.literalFilter = nil
+            } else if let searcher = literalRepresentation == nil ? BucketLiteralSearcher(literals: literals) : nil {
+                self.literalFilter = .buckets(searcher)
+            } else {
+                self.literalFilter = .automaton(AhoCorasick(literals: literals, representation: literalRepresentation))
+            }
+            self.literalOwners = literalOwners
+            self.isFiltered = isFiltered
+        }
+
+        public convenience init(_ expressions: [RegularExpression]) {
+            self.init(expressions, literalRepresentation: nil)
+        }
+
+        public var count: Int {
+            return expressions.count
+        }
+
+        private func evaluate(_ string: String, options: MatchingOptions, range: Range<String.Index>?, limits: MatchLimits, stopAtFirst: Bool) throws -> [Int] {
+            let units = ContiguousArray(string.utf16)
+            let (regionStart, regionLimit) = RegularExpression.utf16Bounds(of: range, in: string)
+            let monitor = limits.isUnlimited ? nil : SearchMonitor(limits: limits)
+            monitor?.beginSearch()
+
+            var isCandidate = isFiltered.map { !$0 }
+            let isAnchored = options.contains(.anchored)
+            let combinedResult = units.withUnsafeBufferPointer { (buffer) -> [Bool]? in
+                if let literalFilter = literalFilter {
+                    for (literal, occurs) in literalFilter.occurringLiterals(in: buffer, from: regionStart, to: regionLimit).enumerated() where occurs {
+                        isCandidate[literalOwners[literal]] = true
+                    }
+                }
+                let input = SearchInput(units: buffer, start: regionStart, end: regionLimit, options: options)
+                return combined.matchingPrograms(in: input, candidates: combinedIndices.map { isCandidate[$0] }, anchored: isAnchored, stopAtFirst: stopAtFirst, monitor: monitor)
+            }
+            if let interruption = monitor?.interruption {
+                throw Error(pattern: expressions.map { $0.pattern }.joined(separator: "\n"), interruption: interruption)
+            }
+
+            var found = [Int]()
+            if let matched = combinedResult {
+                for (program, isMatch) in matched.enumerated() where isMatch {
+                    found.append(combinedIndices[program])
+                }
+            }
+            if stopAtFirst && !found.isEmpty {
+                return found
+            }
+
+            for index in fallbackIndices where isCandidate[index] {
+                if try expressions[index].containsMatch(in: string, options: options, range: range, limits: limits) {
+                    found.append(index)
+                    if stopAtFirst {
+                        break
+                    }
+                }
+            }
+            return found.sorted()
+        }
+
+        /// Returns the indices, in ascending order, of the expressions with a
+        /// match in `string`.
+        public func matchingIndices(in string: String, options: MatchingOptions = [], range: Range<String.Index>? = nil, limits: MatchLimits = MatchLimits()) throws -> [Int] {
+            return try evaluate(string, options: options, range: range, limits: limits, stopAtFirst: false)
+        }
+
+        /// Returns whether any expression has a match in `string`.
+        public func containsMatch(in string: String, options: MatchingOptions = [], range: Range<String.Index>? = nil, limits: MatchLimits = MatchLimits()) throws -> Bool {
+            return try !evaluate(string, options: options, range: range, limits: limits, stopAtFirst: true).isEmpty
+        }
+
+    }
+
+}
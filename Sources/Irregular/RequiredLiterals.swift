@@ -0,0 +1,234 @@
+//
+//  RequiredLiterals.swift
+//  Irregular
+//
+
+extension SyntaxTree {
+
+    /// Literal sets larger than this are given up on, or cut short where a
+    /// shorter literal will do.
+    private static let maximumLiteralCount = 64
+
+    /// Sets of more code points than this, like `\d`, aren't expanded into
+    /// one literal per code point.
+    private static let maximumExpandedSetSize = 4
+
+    /// Repetitions up to this many times, like `ab{2}` or `x?`, are expanded.
+    private static let maximumExpandedRepetition: Int32 = 4
+
+    private static func expand(_ set: ScalarSet) -> [[UInt32]]? {
+        guard !set.isEmpty, set.count <= maximumExpandedSetSize else { return nil }
+        var literals = [[UInt32]]()
+        for range in set.ranges {
+            for scalar in range.lowerBound ... range.upperBound {
+                literals.append([scalar])
+            }
+        }
+        return literals
+    }
+
+    private static func product(_ prefixes: [[UInt32]], _ suffixes: [[UInt32]]) -> [[UInt32]]? {
+        guard prefixes.count * suffixes.count <= maximumLiteralCount else { return nil }
+        var literals = [[UInt32]]()
+        for prefix in prefixes {
+            for suffix in suffixes {
+                literals.append(prefix + suffix)
+            }
+        }
+        return literals
+    }
+
+    /// Every string `node` can match, if there are few enough to list.
+    private func exactLiterals(_ node: NodeIndex) -> [[UInt32]]? {
+        switch self[node] {
+        case .empty, .assertion, .lookaround:
+            return [[]]
+        case let .literal(scalar, caseInsensitive):
+            guard caseInsensitive else { return [[scalar]] }
+            // ICU folds case fully, so `(?i)ss` also matches `ß`; other
+            // literals are each of their case variants.
+            guard !CaseFolding.shared.multipleFoldings.contains(scalar) else { return nil }
+            return CaseFolding.shared.equivalents(of: scalar)?.map { [$0] } ?? [[scalar]]
+        case .set(let index):
+            return SyntaxTree.expand(set(at: index))
+        case .capture(_, let body), .atomic(let body):
+            return exactLiterals(body)
+        case let .concatenation(start, end):
+            var literals: [[UInt32]] = [[]]
+            for child in children(from: start, to: end) {
+                guard let next = exactLiterals(child), let combined = SyntaxTree.product(literals, next) else { return nil }
+                literals = combined
+            }
+            return literals
+        case let .alternation(start, end):
+            var literals = [[UInt32]]()
+            for branch in children(from: start, to: end) {
+                guard let next = exactLiterals(branch), literals.count + next.count <= SyntaxTree.maximumLiteralCount else { return nil }
+                literals.append(contentsOf: next)
+            }
+            return literals
+        case let .repetition(body, min, max, _):
+            guard max >= 0 && max <= SyntaxTree.maximumExpandedRepetition, let once = exactLiterals(body) else { return nil }
+            var power: [[UInt32]] = [[]]
+            var literals = [[UInt32]]()
+            for count in 0 ... max {
+                if count >= min {
+                    guard literals.count + power.count <= SyntaxTree.maximumLiteralCount else { return nil }
+                    literals.append(contentsOf: power)
+                }
+                if count < max {
+                    guard let next = SyntaxTree.product(power, once) else { return nil }
+                    power = next
+                }
+            }
+            return literals
+        case .backreference, .graphemeCluster:
+            return nil
+        }
+    }
+
+    /// Whether `candidate` makes a better filter than `best`: its shortest
+    /// literal is longer, or it has fewer literals.
+    private static func isBetter(_ candidate: [[UInt32]], than best: [[UInt32]]?) -> Bool {
+        guard let candidateLength = candidate.map({ $0.count }).min(), candidateLength > 0 else { return false }
+        guard let best = best, let bestLength = best.map({ $0.count }).min() else { return true }
+        return candidateLength > bestLength || (candidateLength == bestLength && candidate.count < best.count)
+    }
+
+    /// Literals at least one of which every match of `node` contains.
+    private func requiredLiterals(_ node: NodeIndex) -> [[UInt32]]? {
+        if let exact = exactLiterals(node), !exact.contains(where: { $0.isEmpty }) {
+            return exact
+        }
+
+        switch self[node] {
+        case .capture(_, let body), .atomic(let body):
+            return requiredLiterals(body)
+        case let .concatenation(start, end):
+            // Runs of children with few enough strings between them make
+            // literals; any child's required literals will also do.
+            var best: [[UInt32]]?
+            var run: [[UInt32]] = [[]]
+            for child in children(from: start, to: end) {
+                if let exact = exactLiterals(child) {
+                    if let extended = SyntaxTree.product(run, exact) {
+                        run = extended
+                        continue
+                    }
+                    if SyntaxTree.isBetter(run, than: best) {
+                        best = run
+                    }
+                    run = exact
+                } else {
+                    if SyntaxTree.isBetter(run, than: best) {
+                        best = run
+                    }
+                    run = [[]]
+                    if let required = requiredLiterals(child), SyntaxTree.isBetter(required, than: best) {
+                        best = required
+                    }
+                }
+            }
+            if SyntaxTree.isBetter(run, than: best) {
+                best = run
+            }
+            return best
+        case let .alternation(start, end):
+            var literals = [[UInt32]]()
+            for branch in children(from: start, to: end) {
+                guard let required = requiredLiterals(branch), literals.count + required.count <= SyntaxTree.maximumLiteralCount else { return nil }
+                literals.append(contentsOf: required)
+            }
+            return literals
+        case let .repetition(body, min, _, _) where min > 0:
+            return requiredLiterals(body)
+        default:
+            return nil
+        }
+    }
+
+    private static func utf16(_ scalars: [UInt32]) -> [UInt16] {
+        var units = [UInt16]()
+        for scalar in scalars {
+            if scalar >= 0x10000 {
+                units.append(UInt16(0xD800 + ((scalar - 0x10000) >> 10)))
+                units.append(UInt16(0xDC00 + ((scalar - 0x10000) & 0x3FF)))
+            } else {
+                units.append(UInt16(scalar))
+            }
+        }
+        return units
+    }
+
+    /// Literals, in UTF-16, at least one of which every match contains, or
+    /// `nil` if none are known.
+    ///
+    /// For `(GET|POST) /api/v\d+/`, these are `GET /api/v` and
+    /// `POST /api/v`.
+    var requiredLiterals: [[UInt16]]? {
+        return requiredLiterals(root)?.map(SyntaxTree.utf16)
+    }
+
+    /// Every code point `node` can consume, or `nil` if that isn't known.
+    private func consumedCharacters(_ node: NodeIndex) -> ScalarSet? {
+        switch self[node] {
+        case .empty, .assertion:
+            return ScalarSet()
+        case let .literal(scalar, caseInsensitive):
+            return caseInsensitive ? ScalarSet(scalar).caseClosed() : ScalarSet(scalar)
+        case .set(let index):
+            return set(at: index)
+        case .capture(_, let body), .atomic(let body), .repetition(let body, _, _, _):
+            return consumedCharacters(body)
+        case .concatenation(let start, let end), .alternation(let start, let end):
+            var consumed = ScalarSet()
+            for child in children(from: start, to: end) {
+                guard let next = consumedCharacters(child) else { return nil }
+                consumed = consumed.union(next)
+            }
+            return consumed
+        case .lookaround, .backreference, .graphemeCluster:
+            return nil
+        }
+    }
+
+    /// Literals, in UTF-16, one of which every match has after its start,
+    /// and the part of the pattern before them, for patterns like
+    /// `\w+@example\.com` with no literal at the start.
+    ///
+    /// The part before can't consume any literal's first code point, so a
+    /// match that starts before an occurrence of one can't have its literal
+    /// after it.
+    var innerLiterals: (prefix: SyntaxTree, literals: [[UInt16]])? {
+        guard case let .concatenation(start, end) = self[root] else { return nil }
+        let elements = Array(children(from: start, to: end))
+
+        var best: (index: Int, literals: [[UInt32]])?
+        var consumed = ScalarSet()
+        for index in elements.indices.dropFirst() {
+            guard let next = consumedCharacters(elements[index - 1]) else { break }
+            consumed = consumed.union(next)
+
+            var run: [[UInt32]] = [[]]
+            for element in elements[index ..< elements.count] {
+                guard let exact = exactLiterals(element), let extended = SyntaxTree.product(run, exact) else { break }
+                run = extended
+            }
+            if !run.contains(where: { $0.isEmpty || consumed.contains($0[0]) }), SyntaxTree.isBetter(run, than: best?.literals) {
+                best = (index, run)
+            }
+        }
+
+        guard let found = best else { return nil }
+        let index = found.index
+        var prefix = self
+        if index == 1 {
+            prefix.root = elements[0]
+        } else {
+            let (prefixStart, prefixEnd) = prefix.addChildren(elements[0 ..< index])
+            prefix.root = prefix.add(.concatenation(prefixStart, prefixEnd), span: span(of: elements[0]).lowerBound ..< span(of: elements[index - 1]).upperBound)
+        }
+        return (prefix, found.literals.map(SyntaxTree.utf16))
+    }
+
+}
@@ -0,0 +1,122 @@
+//
+//  ScalarClasses.swift
+//  Irregular
+//
+
+/// A partition of the code points into classes that no instruction of a
+/// program tells apart, so a DFA needs one transition per class rather than
+/// per code point.
+///
+/// A pattern like `[a-z]+@[a-z]+\.com` has only a handful of classes: the
+/// letters it names on their own, the rest of `[a-z]`, `@`, `.`, and
+/// everything else.
+struct ScalarClasses {
+
+    /// Which literals and sets contain a run of code points, as indices into
+    /// the program's distinct scalars and then its sets.
+    private struct Signature: Hashable {
+        var atoms: [Int32] = []
+
+        var hashValue: Int {
+            var hash = atoms.count
+            for atom in atoms {
+                hash = (hash &* 31) &+ Int(atom)
+            }
+            return hash
+        }
+
+        static func == (lhs: Signature, rhs: Signature) -> Bool {
+            return lhs.atoms == rhs.atoms
+        }
+    }
+
+    private static let tableWidth = 128
+
+    /// The first code point of each run that reaches past ASCII, and the
+    /// run's class.
+    private var runStarts = ContiguousArray<UInt32>()
+    private var runClasses = ContiguousArray<Int32>()
+
+    private var asciiClasses = ContiguousArray<Int32>(repeating: 0, count: ScalarClasses.tableWidth)
+
+    private(set) var count = 0
+
+    init(_ program: Program) {
+        var scalarAtoms = [UInt32: Int32]()
+        var breaks = Swift.Set<UInt32>([0])
+        func addBreak(_ scalar: UInt32) {
+            if scalar <= ScalarSet.maximum {
+                breaks.insert(scalar)
+            }
+        }
+
+        for instruction in program.instructions {
+            if case .scalar(let scalar) = instruction, scalarAtoms[scalar] == nil {
+                scalarAtoms[scalar] = Int32(scalarAtoms.count)
+                addBreak(scalar)
+                addBreak(scalar + 1)
+            }
+        }
+        for set in program.sets {
+            for range in set.ranges {
+                addBreak(range.lowerBound)
+                addBreak(range.upperBound + 1)
+            }
+        }
+
+        // Every run is a single scalar of a literal or lies wholly inside or
+        // outside each set, so its first code point stands for all of it.
+        let starts = breaks.sorted()
+        var classIndices = [Signature: Int32]()
+        var classes = ContiguousArray<Int32>()
+        classes.reserveCapacity(starts.count)
+        for start in starts {
+            var signature = Signature()
+            if let atom = scalarAtoms[start] {
+                signature.atoms.append(atom)
+            }
+            for (index, set) in program.sets.enumerated() where set.contains(start) {
+                signature.atoms.append(Int32(scalarAtoms.count + index))
+            }
+            if let existing = classIndices[signature] {
+                classes.append(existing)
+            } else {
+                let next = Int32(classIndices.count)
+                classIndices[signature] = next
+                classes.append(next)
+            }
+        }
+        count = classIndices.count
+
+        var run = 0
+        for scalar in 0 ..< ScalarClasses.tableWidth {
+            while run + 1 < starts.count && starts[run + 1] <= UInt32(scalar) {
+                run += 1
+            }
+            asciiClasses[scalar] = classes[run]
+        }
+        for (index, start) in starts.enumerated() where start >= UInt32(ScalarClasses.tableWidth) || index + 1 == starts.count || starts[index + 1] > UInt32(ScalarClasses.tableWidth) {
+            runStarts.append(start)
+            runClasses.append(classes[index])
+        }
+    }
+
+    /// The class of `scalar`.
+    func classOf(_ scalar: UInt32) -> Int {
+        if scalar < UInt32(ScalarClasses.tableWidth) {
+            return Int(asciiClasses[Int(scalar)])
+        }
+
+        // The last run starting at or before `scalar`, halving the candidates
+        // with a conditional move rather than a branch.
+        var length = runStarts.count
+        var base = 0
+        while length > 1 {
+            let half = length / 2
+            base = runStarts[base + half] <= scalar ? base + half : base
+            length -= half
+        }
+        return Int(runClasses[base])
+    }
+
+}
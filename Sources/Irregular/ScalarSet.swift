@@ -0,0 +1,355 @@
+//
+//  ScalarSet.swift
+//  Irregular
+//
+
+import CUnicode
+
+/// A set of Unicode code points, stored as sorted, disjoint, non-adjacent
+/// inclusive ranges.
+///
+/// Lone surrogates are code points like any other, matching how ICU treats
+/// unpaired surrogates in its input.
+struct ScalarSet {
+
+    static let maximum: UInt32 = 0x10FFFF
+
+    /// The range bounds, flattened: `bounds[2 * i] ... bounds[2 * i + 1]`.
+    private(set) var bounds: [UInt32]
+
+    /// Faster membership tests, for sets the native engines match against.
+    private(set) var lookup: ScalarLookup?
+
+    private init(normalizedBounds: [UInt32]) {
+        self.bounds = normalizedBounds
+    }
+
+    init() {
+        self.bounds = []
+    }
+
+    init<S: Sequence>(_ ranges: S) where S.Iterator.Element == ClosedRange<UInt32> {
+        var bounds = [UInt32]()
+        for range in ranges.sorted(by: { $0.lowerBound < $1.lowerBound }) {
+            if let last = bounds.last, range.lowerBound <= last || range.lowerBound - last == 1 {
+                bounds[bounds.count - 1] = max(last, range.upperBound)
+            } else {
+                bounds.append(range.lowerBound)
+                bounds.append(range.upperBound)
+            }
+        }
+        self.bounds = bounds
+    }
+
+    init(_ scalar: UInt32) {
+        self.bounds = [scalar, scalar]
+    }
+
+    static let all = ScalarSet(normalizedBounds: [0, ScalarSet.maximum])
+
+    var rangeCount: Int {
+        return bounds.count / 2
+    }
+
+    var ranges: [ClosedRange<UInt32>] {
+        return stride(from: 0, to: bounds.count, by: 2).map { bounds[$0] ... bounds[$0 + 1] }
+    }
+
+    var isEmpty: Bool {
+        return bounds.isEmpty
+    }
+
+    var isFull: Bool {
+        return bounds == [0, ScalarSet.maximum]
+    }
+
+    /// The only member of a set with exactly one member.
+    var singleScalar: UInt32? {
+        return bounds.count == 2 && bounds[0] == bounds[1] ? bounds[0] : nil
+    }
+
+    /// The number of code points in the set.
+    var count: Int {
+        var count = 0
+        for i in stride(from: 0, to: bounds.count, by: 2) {
+            count += Int(bounds[i + 1] - bounds[i]) + 1
+        }
+        return count
+    }
+
+    func contains(_ scalar: UInt32) -> Bool {
+        if let lookup = lookup {
+            return lookup.contains(scalar)
+        }
+
+        var low = 0, high = rangeCount
+        while low < high {
+            let middle = (low + high) / 2
+            if scalar < bounds[2 * middle] {
+                high = middle
+            } else if scalar > bounds[2 * middle + 1] {
+                low = middle + 1
+            } else {
+                return true
+            }
+        }
+        return false
+    }
+
+    func union(_ other: ScalarSet) -> ScalarSet {
+        return ScalarSet(ranges + other.ranges)
+    }
+
+    func intersection(_ other: ScalarSet) -> ScalarSet {
+        var result = [UInt32]()
+        var i = 0, j = 0
+        while i < bounds.count && j < other.bounds.count {
+            let lower = max(bounds[i], other.bounds[j])
+            let upper = min(bounds[i + 1], other.bounds[j + 1])
+            if lower <= upper {
+                result.append(lower)
+                result.append(upper)
+            }
+            if bounds[i + 1] < other.bounds[j + 1] {
+                i += 2
+            } else {
+                j += 2
+            }
+        }
+        return ScalarSet(normalizedBounds: result)
+    }
+
+    func inverted() -> ScalarSet {
+        var result = [UInt32]()
+        var next: UInt32 = 0
+        var isAtMaximum = false
+        for i in stride(from: 0, to: bounds.count, by: 2) {
+            if bounds[i] > next {
+                result.append(next)
+                result.append(bounds[i] - 1)
+            }
+            if bounds[i + 1] == ScalarSet.maximum {
+                isAtMaximum = true
+            } else {
+                next = bounds[i + 1] + 1
+            }
+        }
+        if !isAtMaximum {
+            result.append(next)
+            result.append(ScalarSet.maximum)
+        }
+        return ScalarSet(normalizedBounds: result)
+    }
+
+    func subtracting(_ other: ScalarSet) -> ScalarSet {
+        return intersection(other.inverted())
+    }
+
+}
+
+extension ScalarSet: Equatable {
+
+    static func == (lhs: ScalarSet, rhs: ScalarSet) -> Bool {
+        return lhs.bounds == rhs.bounds
+    }
+
+}
+
+extension ScalarSet: Hashable {
+
+    var hashValue: Int {
+        var hash = bounds.count
+        for bound in bounds {
+            hash = (hash &* 31) &+ Int(bound)
+        }
+        return hash
+    }
+
+}
+
+// MARK: - Lookup tables
+
+extension ScalarSet {
+
+    /// Returns the same set with lookup tables for testing membership, for
+    /// sets tested at every position of a search.
+    func compiledForLookup() -> ScalarSet {
+        guard lookup == nil else { return self }
+        var compiled = self
+        compiled.lookup = ScalarLookup(bounds: bounds)
+        return compiled
+    }
+
+}
+
+/// Membership tables for a `ScalarSet`: a bitmap for Latin-1, and above it
+/// either sorted ranges searched without branches or, for sets of many
+/// ranges like `\p{L}`, a two-stage table of 256-bit blocks.
+final class ScalarLookup {
+
+    /// A 256-bit block of the two-stage table.
+    private struct Block: Hashable {
+        var words: (UInt64, UInt64, UInt64, UInt64) = (0, 0, 0, 0)
+
+        mutating func insert(from lower: Int, through upper: Int) {
+            for word in lower >> 6 ... upper >> 6 {
+                let low = max(lower, word << 6) & 63
+                let high = min(upper, word << 6 + 63) & 63
+                let mask = (UInt64.max >> UInt64(63 - high)) & (UInt64.max << UInt64(low))
+                switch word {
+                case 0: words.0 |= mask
+                case 1: words.1 |= mask
+                case 2: words.2 |= mask
+                default: words.3 |= mask
+                }
+            }
+        }
+
+        var hashValue: Int {
+            return Int(truncatingBitPattern: words.0 ^ (words.1 &* 31) ^ (words.2 &* 961) ^ (words.3 &* 29791))
+        }
+
+        static func == (lhs: Block, rhs: Block) -> Bool {
+            return lhs.words.0 == rhs.words.0 && lhs.words.1 == rhs.words.1 && lhs.words.2 == rhs.words.2 && lhs.words.3 == rhs.words.3
+        }
+    }
+
+    /// Sets with more ranges above Latin-1 than this get a two-stage table.
+    static let twoStageThreshold = 16
+
+    private static let blockCount = Int(ScalarSet.maximum >> 8) + 1
+
+    private var latin1 = ContiguousArray<UInt64>(repeating: 0, count: 4)
+
+    /// The ranges above Latin-1, if searched.
+    private var starts = ContiguousArray<UInt32>()
+    private var ends = ContiguousArray<UInt32>()
+
+    /// The block of each 256 code points, and the blocks' words, four each.
+    private var stage1 = ContiguousArray<UInt16>()
+    private var stage2 = ContiguousArray<UInt64>()
+
+    init(bounds: [UInt32]) {
+        var latin1Block = Block()
+        for i in stride(from: 0, to: bounds.count, by: 2) {
+            if bounds[i] <= 0xFF {
+                latin1Block.insert(from: Int(bounds[i]), through: Int(min(bounds[i + 1], 0xFF)))
+            }
+            if bounds[i + 1] > 0xFF {
+                starts.append(max(bounds[i], 0x100))
+                ends.append(bounds[i + 1])
+            }
+        }
+        latin1 = [latin1Block.words.0, latin1Block.words.1, latin1Block.words.2, latin1Block.words.3]
+
+        guard starts.count > ScalarLookup.twoStageThreshold else { return }
+        var blockIndices = [Block: UInt16]()
+        var range = 0
+        stage1.reserveCapacity(ScalarLookup.blockCount)
+        for blockNumber in 0 ..< ScalarLookup.blockCount {
+            let blockStart = UInt32(blockNumber << 8), blockEnd = blockStart + 0xFF
+            var block = Block()
+            while range < starts.count && ends[range] < blockStart {
+                range += 1
+            }
+            var overlapping = range
+            while overlapping < starts.count && starts[overlapping] <= blockEnd {
+                block.insert(from: Int(max(starts[overlapping], blockStart) - blockStart), through: Int(min(ends[overlapping], blockEnd) - blockStart))
+                overlapping += 1
+            }
+
+            if let index = blockIndices[block] {
+                stage1.append(index)
+            } else {
+                let index = UInt16(blockIndices.count)
+                blockIndices[block] = index
+                stage1.append(index)
+                stage2.append(contentsOf: [block.words.0, block.words.1, block.words.2, block.words.3])
+            }
+        }
+        starts = []
+        ends = []
+    }
+
+    func contains(_ scalar: UInt32) -> Bool {
+        if scalar <= 0xFF {
+            return latin1[Int(scalar >> 6)] & (1 << UInt64(scalar & 63)) != 0
+        }
+
+        if !stage1.isEmpty {
+            let bit = Int(scalar & 0xFF)
+            return stage2[Int(stage1[Int(scalar >> 8)]) * 4 + bit >> 6] & (1 << UInt64(bit & 63)) != 0
+        }
+
+        // The last range starting at or before `scalar`, halving the
+        // candidates with a conditional move rather than a branch.
+        var length = starts.count
+        guard length > 0 else { return false }
+        var base = 0
+        while length > 1 {
+            let half = length / 2
+            base = starts[base + half] <= scalar ? base + half : base
+            length -= half
+        }
+        return starts[base] <= scalar && scalar <= ends[base]
+    }
+
+}
+
+// MARK: - ICU sets
+
+extension ScalarSet {
+
+    private init(_ set: UnsafeMutablePointer<USet>) {
+        var ranges = [ClosedRange<UInt32>]()
+        for i in 0 ..< set.pointee.itemCount() {
+            var status = UErrorCode.ZERO_ERROR
+            var start: Int32 = 0, end: Int32 = 0
+            // Strings added by case closure have a nonzero length; skip them.
+            if set.pointee.item(at: i, start: &start, end: &end, string: nil, capacity: 0, status: &status) == 0 {
+                ranges.append(UInt32(start) ... UInt32(end))
+            }
+        }
+        self.init(ranges)
+    }
+
+    /// Creates a set from an ICU `UnicodeSet` pattern, such as `[\p{L}]` or
+    /// `[:alpha:]`, or returns `nil` if ICU rejects it.
+    init?(icuPattern pattern: String) {
+        var status = UErrorCode.ZERO_ERROR
+        let units = Array(pattern.utf16)
+        guard let set = USet.open(pattern: units, length: Int32(units.count), status: &status) else { return nil }
+        defer { set.pointee.close() }
+        guard status.isSuccess else { return nil }
+        self.init(set)
+    }
+
+    /// Returns the set plus every code point that is equal to a member under
+    /// case folding.
+    func caseClosed() -> ScalarSet {
+        if let scalar = singleScalar {
+            guard let equivalents = CaseFolding.shared.equivalents(of: scalar) else { return self }
+            return ScalarSet(equivalents.map { $0 ... $0 })
+        }
+        return CaseFolding.shared.closure(of: self)
+    }
+
+    /// `\w`, as ICU defines it.
+    static let word = ScalarSet(icuPattern: "[\\p{Alphabetic}\\p{Mark}\\p{Decimal_Number}\\p{Connector_Punctuation}\\u200c\\u200d]")!.compiledForLookup()
+
+    /// Characters `\b` skips over to find the character before a position.
+    static let wordBoundaryTransparent = ScalarSet(icuPattern: "[\\p{Grapheme_Extend}\\p{Cf}]")!.compiledForLookup()
+
+    /// `\d`.
+    static let digit = ScalarSet(icuPattern: "[\\p{Nd}]")!
+
+    /// `\s`.
+    static let whitespace = ScalarSet(icuPattern: "[\\t\\n\\f\\r\\p{Z}]")!
+
+    /// `\h`.
+    static let horizontalWhitespace = ScalarSet(icuPattern: "[\\t\\p{Zs}]")!
+
+    /// `\v`, and the line terminators `.` doesn't match by default.
+    static let lineTerminators = ScalarSet([0x0A ... 0x0D, 0x85 ... 0x85, 0x2028 ... 0x2029])
+
+}
@@ -0,0 +1,419 @@
+//
+//  Serialization.swift
+//  Irregular
+//
+
+/// Writes the little-endian fields of a serialized blob.
+struct SerializationWriter {
+
+    private(set) var bytes = [UInt8]()
+
+    mutating func write(_ value: UInt8) {
+        bytes.append(value)
+    }
+
+    mutating func write(_ value: UInt32) {
+        for shift: UInt32 in [0, 8, 16, 24] {
+            bytes.append(UInt8(truncatingBitPattern: value >> shift))
+        }
+    }
+
+    mutating func write(_ value: Int32) {
+        write(UInt32(bitPattern: value))
+    }
+
+    mutating func write(_ value: Int) {
+        let bits = UInt64(bitPattern: Int64(value))
+        write(UInt32(truncatingBitPattern: bits))
+        write(UInt32(truncatingBitPattern: bits >> 32))
+    }
+
+    mutating func write(_ value: Bool) {
+        write(UInt8(value ? 1 : 0))
+    }
+
+    mutating func write(_ string: String) {
+        let units = Array(string.utf16)
+        write(UInt32(units.count))
+        for unit in units {
+            write(UInt8(truncatingBitPattern: unit))
+            write(UInt8(truncatingBitPattern: unit >> 8))
+        }
+    }
+
+}
+
+/// Reads the fields `SerializationWriter` writes, throwing
+/// `INVALID_FORMAT_ERROR` at the end of the blob.
+struct SerializationReader {
+
+    private let bytes: UnsafeRawBufferPointer
+    private var offset = 0
+
+    init(_ bytes: UnsafeRawBufferPointer) {
+        self.bytes = bytes
+    }
+
+    var isAtEnd: Bool {
+        return offset == bytes.count
+    }
+
+    mutating func readByte() throws -> UInt8 {
+        guard offset < bytes.count else { throw RegularExpression.Error(pattern: "", code: .INVALID_FORMAT_ERROR) }
+        offset += 1
+        return bytes[offset - 1]
+    }
+
+    mutating func readUInt32() throws -> UInt32 {
+        var value: UInt32 = 0
+        for shift: UInt32 in [0, 8, 16, 24] {
+            value |= UInt32(try readByte()) << shift
+        }
+        return value
+    }
+
+    mutating func readInt32() throws -> Int32 {
+        return Int32(bitPattern: try readUInt32())
+    }
+
+    mutating func readInt() throws -> Int {
+        let low = UInt64(try readUInt32())
+        let high = UInt64(try readUInt32())
+        return Int(Int64(bitPattern: high << 32 | low))
+    }
+
+    mutating func readBool() throws -> Bool {
+        return try readByte() != 0
+    }
+
+    mutating func readString() throws -> String {
+        let count = Int(try readUInt32())
+        guard count <= (bytes.count - offset) / 2 else { throw RegularExpression.Error(pattern: "", code: .INVALID_FORMAT_ERROR) }
+        var units = [UInt16]()
+        units.reserveCapacity(count)
+        for _ in 0 ..< count {
+            let low = UInt16(try readByte())
+            units.append(low | UInt16(try readByte()) << 8)
+        }
+        return String(decodingUTF16: units)
+    }
+
+}
+
+extension SyntaxTree {
+
+    private static func code(of assertion: Assertion) -> UInt8 {
+        switch assertion {
+        case .startOfText: return 0
+        case .endOfText: return 1
+        case .endOfTextOrBeforeFinalTerminator(let unixLines): return unixLines ? 3 : 2
+        case .startOfLine(let unixLines): return unixLines ? 5 : 4
+        case .endOfLine(let unixLines): return unixLines ? 7 : 6
+        case .wordBoundary: return 8
+        case .notWordBoundary: return 9
+        case .previousMatchEnd: return 10
+        }
+    }
+
+    private static func assertion(code: UInt8) -> Assertion? {
+        switch code {
+        case 0: return .startOfText
+        case 1: return .endOfText
+        case 2, 3: return .endOfTextOrBeforeFinalTerminator(unixLines: code == 3)
+        case 4, 5: return .startOfLine(unixLines: code == 5)
+        case 6, 7: return .endOfLine(unixLines: code == 7)
+        case 8: return .wordBoundary
+        case 9: return .notWordBoundary
+        case 10: return .previousMatchEnd
+        default: return nil
+        }
+    }
+
+    private static let repetitions: [Repetition] = [.greedy, .lazy, .possessive]
+    private static let lookarounds: [Lookaround] = [.ahead, .negativeAhead, .behind, .negativeBehind]
+
+    func serialize(into writer: inout SerializationWriter) {
+        writer.write(Int32(sets.count))
+        for set in sets {
+            let ranges = set.ranges
+            writer.write(Int32(ranges.count))
+            for range in ranges {
+                writer.write(range.lowerBound)
+                writer.write(range.upperBound)
+            }
+        }
+
+        writer.write(Int32(children.count))
+        for child in children {
+            writer.write(child)
+        }
+
+        writer.write(Int32(nodes.count))
+        for (node, span) in zip(nodes, spans) {
+            switch node {
+            case .empty:
+                writer.write(UInt8(0))
+            case let .literal(scalar, caseInsensitive):
+                writer.write(UInt8(1))
+                writer.write(scalar)
+                writer.write(caseInsensitive)
+            case .set(let index):
+                writer.write(UInt8(2))
+                writer.write(index)
+            case .assertion(let assertion):
+                writer.write(UInt8(3))
+                writer.write(SyntaxTree.code(of: assertion))
+            case let .capture(number, body):
+                writer.write(UInt8(4))
+                writer.write(number)
+                writer.write(body)
+            case let .concatenation(start, end):
+                writer.write(UInt8(5))
+                writer.write(start)
+                writer.write(end)
+            case let .alternation(start, end):
+                writer.write(UInt8(6))
+                writer.write(start)
+                writer.write(end)
+            case let .repetition(body, min, max, repetition):
+                writer.write(UInt8(7))
+                writer.write(body)
+                writer.write(min)
+                writer.write(max)
+                writer.write(UInt8(SyntaxTree.repetitions.index(of: repetition)!))
+            case let .lookaround(body, kind):
+                writer.write(UInt8(8))
+                writer.write(body)
+                writer.write(UInt8(SyntaxTree.lookarounds.index(of: kind)!))
+            case .atomic(let body):
+                writer.write(UInt8(9))
+                writer.write(body)
+            case let .backreference(number, caseInsensitive):
+                writer.write(UInt8(10))
+                writer.write(number)
+                writer.write(caseInsensitive)
+            case .graphemeCluster:
+                writer.write(UInt8(11))
+            }
+            writer.write(span.lowerBound)
+            writer.write(span.upperBound)
+        }
+
+        writer.write(root)
+        writer.write(Int32(captureCount))
+        writer.write(UInt32(features.rawValue))
+        writer.write(Int32(captureNames.count))
+        for (name, number) in captureNames.sorted(by: { $0.value < $1.value }) {
+            writer.write(name)
+            writer.write(Int32(number))
+        }
+    }
+
+    /// Reads a tree `serialize(into:)` wrote, checking that every node refers
+    /// only to nodes, children and sets before it, so the tree has no cycles
+    /// and no reference is out of bounds, and that literals are code points
+    /// and groups are numbered within `captureCount`.
+    init(from reader: inout SerializationReader) throws {
+        self.init()
+        let invalid = RegularExpression.Error(pattern: "", code: .INVALID_FORMAT_ERROR)
+
+        let setCount = try reader.readInt32()
+        for _ in 0 ..< max(setCount, 0) {
+            var ranges = [ClosedRange<UInt32>]()
+            for _ in 0 ..< max(try reader.readInt32(), 0) {
+                let lower = try reader.readUInt32(), upper = try reader.readUInt32()
+                guard lower <= upper, upper <= ScalarSet.maximum else { throw invalid }
+                ranges.append(lower ... upper)
+            }
+            guard add(ScalarSet(ranges)) == Int32(sets.count - 1) else { throw invalid }
+        }
+
+        var childNodes = [NodeIndex]()
+        for _ in 0 ..< max(try reader.readInt32(), 0) {
+            childNodes.append(try reader.readInt32())
+        }
+        _ = addChildren(childNodes)
+
+        let nodeCount = try reader.readInt32()
+        for index in 0 ..< max(nodeCount, 0) {
+            func precedes(_ node: NodeIndex) -> Bool {
+                return node >= 0 && node < index
+            }
+            func isRun(_ start: Int32, _ end: Int32) -> Bool {
+                return start >= 0 && start <= end && Int(end) <= childNodes.count && !childNodes[Int(start) ..< Int(end)].contains { !precedes($0) }
+            }
+
+            let node: Node
+            let tag = try reader.readByte()
+            switch tag {
+            case 0:
+                node = .empty
+            case 1:
+                let scalar = try reader.readUInt32()
+                guard scalar <= ScalarSet.maximum else { throw invalid }
+                node = .literal(scalar, caseInsensitive: try reader.readBool())
+            case 2:
+                let set = try reader.readInt32()
+                guard set >= 0 && Int(set) < sets.count else { throw invalid }
+                node = .set(set)
+            case 3:
+                guard let assertion = SyntaxTree.assertion(code: try reader.readByte()) else { throw invalid }
+                node = .assertion(assertion)
+            case 4:
+                let number = try reader.readInt32(), body = try reader.readInt32()
+                guard precedes(body) else { throw invalid }
+                node = .capture(number, body)
+            case 5, 6:
+                let start = try reader.readInt32(), end = try reader.readInt32()
+                guard isRun(start, end) else { throw invalid }
+                node = tag == 5 ? .concatenation(start, end) : .alternation(start, end)
+            case 7:
+                let body = try reader.readInt32(), min = try reader.readInt32(), max = try reader.readInt32()
+                let repetition = Int(try reader.readByte())
+                guard precedes(body), min >= 0, max < 0 || max >= min, repetition < SyntaxTree.repetitions.count else { throw invalid }
+                node = .repetition(body, min: min, max: max, SyntaxTree.repetitions[repetition])
+            case 8:
+                let body = try reader.readInt32()
+                let kind = Int(try reader.readByte())
+                guard precedes(body), kind < SyntaxTree.lookarounds.count else { throw invalid }
+                node = .lookaround(body, SyntaxTree.lookarounds[kind])
+            case 9:
+                let body = try reader.readInt32()
+                guard precedes(body) else { throw invalid }
+                node = .atomic(body)
+            case 10:
+                node = .backreference(try reader.readInt32(), caseInsensitive: try reader.readBool())
+            case 11:
+                node = .graphemeCluster
+            default:
+                throw invalid
+            }
+            let lower = try reader.readInt32(), upper = try reader.readInt32()
+            guard lower <= upper else { throw invalid }
+            _ = add(node, span: lower ..< upper)
+        }
+
+        root = try reader.readInt32()
+        guard root >= 0 && Int(root) < nodes.count else { throw invalid }
+        captureCount = Int(try reader.readInt32())
+        guard captureCount >= 0 && captureCount <= nodes.count else { throw invalid }
+        for node in nodes {
+            switch node {
+            case .capture(let number, _), .backreference(let number, _):
+                guard number >= 1 && Int(number) <= captureCount else { throw invalid }
+            default:
+                break
+            }
+        }
+        let featureBits = try reader.readUInt32()
+        guard featureBits <= UInt32(UInt16.max) else { throw invalid }
+        features = Features(rawValue: UInt16(featureBits))
+        for _ in 0 ..< max(try reader.readInt32(), 0) {
+            let name = try reader.readString()
+            let number = Int(try reader.readInt32())
+            guard number >= 1 && number <= captureCount else { throw invalid }
+            captureNames[name] = number
+        }
+    }
+
+}
+
+extension RegularExpression {
+
+    /// The version of the format `serialize(_:)` writes. Blobs of any other
+    /// version are rejected rather than misread.
+    public static let serializationVersion: UInt32 = 3
+
+    /// "IRRX", which begins every blob.
+    private static let serializationMagic: UInt32 = 0x58525249
+
+    /// What a blob stores of each regular expression.
+    fileprivate struct Record {
+        var pattern: String
+        var options: Options
+        var syntax: SyntaxTree?
+        var dfaCacheCapacity: Int
+        var backtrackingMemoryBudget: Int
+    }
+
+    /// Returns a blob holding `regularExpressions`, parsed, for
+    /// `deserialize(_:)` to load without parsing them again.
+    ///
+    /// Only the pattern, its options, the parsed tree, and the limits are
+    /// stored: the optimized trees, programs, literal tables, and DFAs built
+    /// from it take little time to rebuild, and DFA states are built during
+    /// searches anyway. The tree is stored as parsed rather than optimized
+    /// so that loading rebuilds exactly what parsing would have, and
+    /// `optimizations` describe the trees that run. Blobs are only readable by the same
+    /// `serializationVersion`.
+    public static func serialize(_ regularExpressions: [RegularExpression]) -> [UInt8] {
+        var writer = SerializationWriter()
+        writer.write(serializationMagic)
+        writer.write(serializationVersion)
+        writer.write(Int32(regularExpressions.count))
+        for regularExpression in regularExpressions {
+            writer.write(regularExpression.pattern)
+            writer.write(UInt32(regularExpression.options.rawValue))
+            writer.write(regularExpression.dfaCacheCapacity)
+            writer.write(regularExpression.backtrackingMemoryBudget)
+            writer.write(regularExpression.parsed != nil)
+            regularExpression.parsed?.serialize(into: &writer)
+        }
+        return writer.bytes
+    }
+
+    /// Loads the regular expressions of a blob `serialize(_:)` wrote.
+    ///
+    /// The ICU form of each pattern is only compiled when a search first
+    /// needs it, so loading one the native engines match costs no more than
+    /// rebuilding them from its tree.
+    ///
+    /// - throws: `INVALID_FORMAT_ERROR` if `bytes` aren't a blob of this
+    ///   `serializationVersion`.
+    public static func deserialize(_ bytes: UnsafeRawBufferPointer) throws -> [RegularExpression] {
+        return try records(in: bytes).map { try RegularExpression($0) }
+    }
+
+    public static func deserialize(_ bytes: [UInt8]) throws -> [RegularExpression] {
+        return try bytes.withUnsafeBytes { try deserialize($0) }
+    }
+
+    /// Loads the one regular expression of a blob `serialize(_:)` wrote.
+    public convenience init(serialized bytes: UnsafeRawBufferPointer) throws {
+        let records = try RegularExpression.records(in: bytes)
+        guard records.count == 1 else { throw Error(pattern: "", code: .INVALID_FORMAT_ERROR) }
+        try self.init(records[0])
+    }
+
+    public convenience init(serialized bytes: [UInt8]) throws {
+        let records = try bytes.withUnsafeBytes { try RegularExpression.records(in: $0) }
+        guard records.count == 1 else { throw Error(pattern: "", code: .INVALID_FORMAT_ERROR) }
+        try self.init(records[0])
+    }
+
+    fileprivate convenience init(_ record: Record) throws {
+        try self.init(pattern: record.pattern, options: record.options, parsed: record.syntax, dfaCacheCapacity: record.dfaCacheCapacity, backtrackingMemoryBudget: record.backtrackingMemoryBudget)
+    }
+
+    private static func records(in bytes: UnsafeRawBufferPointer) throws -> [Record] {
+        let invalid = Error(pattern: "", code: .INVALID_FORMAT_ERROR)
+        var reader = SerializationReader(bytes)
+        guard try reader.readUInt32() == serializationMagic, try reader.readUInt32() == serializationVersion else { throw invalid }
+
+        var records = [Record]()
+        for _ in 0 ..< max(try reader.readInt32(), 0) {
+            let pattern = try reader.readString()
+            let options = Options(rawValue: try reader.readUInt32())
+            let dfaCacheCapacity = try reader.readInt()
+            let backtrackingMemoryBudget = try reader.readInt()
+            var syntax: SyntaxTree?
+            if try reader.readBool() {
+                syntax = try SyntaxTree(from: &reader)
+            }
+            records.append(Record(pattern: pattern, options: options, syntax: syntax, dfaCacheCapacity: dfaCacheCapacity, backtrackingMemoryBudget: backtrackingMemoryBudget))
+        }
+        guard reader.isAtEnd else { throw invalid }
+        return records
+    }
+
+}
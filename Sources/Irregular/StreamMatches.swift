@@ -0,0 +1,303 @@
+//
+//  StreamMatches.swift
+//  Irregular
+//
+
+#if os(Linux)
+import Glibc
+#else
+import Darwin
+#endif
+import CUnicode
+
+private final class StreamBuffer {
+
+    /// How many code units of already-searched text are kept in front of the
+    /// search position so look-behind, `\b`, and `^` see real context.
+    static let contextLength = 64
+
+    let capacity: Int
+    let units: UnsafeMutablePointer<UInt16>
+    var count = 0
+
+    /// Stream offset, in UTF-16 code units, of `units[0]`.
+    var streamOffset: Int64 = 0
+
+    /// Where the next search begins, relative to `units`.
+    var searchStart = 0
+
+    /// Set after an empty match; the next search must begin one code point
+    /// later so it doesn't find the same match again.
+    var isPastEmptyMatch = false
+
+    var isAtEnd = false
+
+    private let bytes: UnsafeMutablePointer<UInt8>
+    private var partialCount = 0
+
+    init(capacity: Int) {
+        self.capacity = capacity
+        self.units = UnsafeMutablePointer<UInt16>.allocate(capacity: capacity)
+        self.bytes = UnsafeMutablePointer<UInt8>.allocate(capacity: capacity)
+    }
+
+    deinit {
+        units.deallocate(capacity: capacity)
+        bytes.deallocate(capacity: capacity)
+    }
+
+    var isFull: Bool {
+        return capacity - count < 4
+    }
+
+    /// Drops text that can no longer take part in a match, keeping a little
+    /// context before the search position.
+    func compact() {
+        let keepFrom = max(0, searchStart - StreamBuffer.contextLength)
+        guard keepFrom > 0 else { return }
+        units.assign(from: units + keepFrom, count: count - keepFrom)
+        count -= keepFrom
+        searchStart -= keepFrom
+        streamOffset += Int64(keepFrom)
+    }
+
+    /// Reads and transcodes another chunk of UTF-8 into the free space.
+    ///
+    /// Every UTF-8 sequence transcodes to no more UTF-16 code units than it
+    /// has bytes, so reading at most the free capacity never overflows.
+    func fill(using read: (UnsafeMutablePointer<UInt8>, Int) throws -> Int) throws {
+        let readCount = try read(bytes + partialCount, capacity - count - partialCount)
+        if readCount <= 0 {
+            isAtEnd = true
+        }
+        let available = partialCount + max(readCount, 0)
+
+        var i = 0
+        decoding: while i < available {
+            let lead = bytes[i]
+            let length: Int
+            let minimumSecond: UInt8, maximumSecond: UInt8
+            switch lead {
+            case 0x00 ... 0x7F:
+                units[count] = UInt16(lead)
+                count += 1
+                i += 1
+                continue decoding
+            case 0xC2 ... 0xDF:
+                (length, minimumSecond, maximumSecond) = (2, 0x80, 0xBF)
+            case 0xE0:
+                (length, minimumSecond, maximumSecond) = (3, 0xA0, 0xBF)
+            case 0xED:
+                (length, minimumSecond, maximumSecond) = (3, 0x80, 0x9F)
+            case 0xE1 ... 0xEF:
+                (length, minimumSecond, maximumSecond) = (3, 0x80, 0xBF)
+            case 0xF0:
+                (length, minimumSecond, maximumSecond) = (4, 0x90, 0xBF)
+            case 0xF4:
+                (length, minimumSecond, maximumSecond) = (4, 0x80, 0x8F)
+            case 0xF1 ... 0xF3:
+                (length, minimumSecond, maximumSecond) = (4, 0x80, 0xBF)
+            default:
+                units[count] = 0xFFFD
+                count += 1
+                i += 1
+                continue decoding
+            }
+
+            var scalar = UInt32(lead) & (0xFF >> UInt32(length + 1))
+            var j = 1
+            while j < length {
+                guard i + j < available else {
+                    if isAtEnd { break }
+                    // Split sequence; wait for the rest of it.
+                    break decoding
+                }
+                let byte = bytes[i + j]
+                let minimum = j == 1 ? minimumSecond : 0x80
+                let maximum = j == 1 ? maximumSecond : 0xBF
+                guard byte >= minimum && byte <= maximum else { break }
+                scalar = (scalar << 6) | (UInt32(byte) & 0x3F)
+                j += 1
+            }
+
+            if j < length {
+                units[count] = 0xFFFD
+                count += 1
+                i += j
+            } else if scalar >= 0x10000 {
+                units[count] = UInt16(0xD800 + ((scalar - 0x10000) >> 10))
+                units[count + 1] = UInt16(0xDC00 + ((scalar - 0x10000) & 0x3FF))
+                count += 2
+                i += length
+            } else {
+                units[count] = UInt16(scalar)
+                count += 1
+                i += length
+            }
+        }
+
+        partialCount = available - i
+        if partialCount > 0 {
+            bytes.assign(from: bytes + i, count: partialCount)
+        }
+    }
+
+}
+
+extension RegularExpression {
+
+    /// A match found while scanning a stream.
+    public struct StreamMatch {
+
+        /// The offset from the start of the stream, in UTF-16 code units, of
+        /// the start of `match.source`.
+        public let utf16Offset: Int64
+
+        /// The match and its capture groups. Its source text only spans the
+        /// match, not the entire stream.
+        public let match: MatchGroup
+
+    }
+
+    /// Matches found in UTF-8 text read incrementally from a stream.
+    ///
+    /// Only a bounded window of the stream is kept in memory. Text is
+    /// discarded once ICU reports that no match attempt could reach it; when
+    /// a match attempt runs into the end of the window (`hitEnd`), the
+    /// unresolved tail is kept and the search is retried after reading more.
+    /// A match longer than the window is reported truncated to the window.
+    public struct StreamMatches: IteratorProtocol, Sequence {
+
+        private let base: RegularExpression
+        private let buffer: StreamBuffer
+        private let read: (UnsafeMutablePointer<UInt8>, Int) throws -> Int
+
+        fileprivate init(base: RegularExpression, capacity: Int, read: @escaping (UnsafeMutablePointer<UInt8>, Int) throws -> Int) {
+            self.base = base
+            self.buffer = StreamBuffer(capacity: capacity)
+            self.read = read
+        }
+
+        public mutating func next() -> StreamMatch? {
+            return (try? nextMatch()) ?? nil
+        }
+
+        /// Returns the next match, or `nil` at the end of the stream.
+        ///
+        /// Unlike `next()`, this surfaces read errors.
+        public mutating func nextMatch() throws -> StreamMatch? {
+            while true {
+                if let match = try findFinalMatch() {
+                    return match
+                } else if buffer.isAtEnd {
+                    return nil
+                }
+
+                buffer.compact()
+                if buffer.isFull {
+                    // Nothing could be dropped: give up on attempts starting
+                    // in the front half of the window to bound memory.
+                    buffer.searchStart = max(buffer.searchStart + 1, buffer.count - buffer.capacity / 2)
+                    buffer.isPastEmptyMatch = false
+                    buffer.compact()
+                }
+                try buffer.fill(using: read)
+            }
+        }
+
+        /// Searches the window, returning a match only once more input can no
+        /// longer change it.
+        private mutating func findFinalMatch() throws -> StreamMatch? {
+            if buffer.isPastEmptyMatch {
+                guard buffer.searchStart < buffer.count else { return nil }
+                let isHighSurrogate = (0xD800 ..< 0xDC00).contains(buffer.units[buffer.searchStart])
+                guard !isHighSurrogate || buffer.searchStart + 1 < buffer.count || buffer.isAtEnd else { return nil }
+                buffer.searchStart += isHighSurrogate && buffer.searchStart + 1 < buffer.count ? 2 : 1
+                buffer.isPastEmptyMatch = false
+            }
+
+            guard buffer.searchStart < buffer.count || buffer.isAtEnd else { return nil }
+
+            var status = UErrorCode.ZERO_ERROR
+            base.handle.pointee.setTextString(buffer.units, length: Int32(buffer.count), status: &status)
+            let found = base.handle.pointee.findFirstMatch(startingAtIndex: Int64(buffer.searchStart), status: &status) != 0
+            let hitEnd = base.handle.pointee.hasHitEnd(status: &status) != 0
+            guard status.isSuccess else {
+                throw Error(pattern: base.pattern, code: status)
+            }
+
+            guard found else {
+                if !hitEnd {
+                    // No attempt reached the end of the window; every
+                    // position searched is a definite failure.
+                    buffer.searchStart = buffer.count
+                }
+                return nil
+            }
+
+            if hitEnd && !buffer.isAtEnd && !buffer.isFull {
+                return nil
+            }
+
+            let groupCount = Int(base.handle.pointee.numberOfCaptureGroups(status: &status))
+            var offsets = [(Int, Int)]()
+            for i in 0 ... max(groupCount, 0) {
+                let start = base.handle.pointee.startIndex(forGroupAtIndex: Int32(i), status: &status)
+                let end = base.handle.pointee.endIndex(forGroupAtIndex: Int32(i), status: &status)
+                offsets.append((Int(start), Int(end)))
+            }
+            guard status.isSuccess else {
+                throw Error(pattern: base.pattern, code: status)
+            }
+
+            let matched = offsets.filter { $0.0 >= 0 && $0.1 >= $0.0 }
+            let lower = matched.map({ $0.0 }).min() ?? offsets[0].0
+            let upper = matched.map({ $0.1 }).max() ?? offsets[0].1
+            let source = String(decodingUTF16: UnsafeBufferPointer(start: buffer.units + lower, count: upper - lower))
+
+            let match = MatchGroup(ranges: offsets.map({ (start, end) in
+                guard start >= 0, end >= start,
+                    let startIndex = source.utf16.index(source.utf16.startIndex, offsetBy: start - lower).samePosition(in: source),
+                    let endIndex = source.utf16.index(source.utf16.startIndex, offsetBy: end - lower).samePosition(in: source) else {
+                    return source.endIndex ..< source.endIndex
+                }
+                return startIndex ..< endIndex
+            }), within: source)
+
+            buffer.searchStart = offsets[0].1
+            buffer.isPastEmptyMatch = offsets[0].0 == offsets[0].1
+
+            return StreamMatch(utf16Offset: buffer.streamOffset + Int64(lower), match: match)
+        }
+
+    }
+
+    /// Returns matches in UTF-8 text supplied by `read`, which fills up to the
+    /// given number of bytes and returns how many it wrote, or zero at the
+    /// end of the stream.
+    ///
+    /// - parameter bufferCapacity: The most UTF-16 code units of the stream
+    ///   held in memory at once.
+    public func matches(readingWith read: @escaping (UnsafeMutablePointer<UInt8>, Int) throws -> Int, bufferCapacity: Int = 1 << 16) throws -> StreamMatches {
+        precondition(bufferCapacity >= StreamBuffer.contextLength * 4, "stream buffer is too small")
+        let regex = try checkOut(options: [])
+        return StreamMatches(base: regex, capacity: bufferCapacity, read: read)
+    }
+
+    /// Returns matches in UTF-8 text read from a file descriptor, such as a
+    /// pipe, socket, or `FileHandle.fileDescriptor`, until end-of-file.
+    public func matches(inFileDescriptor fileDescriptor: Int32, bufferCapacity: Int = 1 << 16) throws -> StreamMatches {
+        let pattern = self.pattern
+        return try matches(readingWith: { (bytes, count) in
+            while true {
+                let result = read(fileDescriptor, bytes, count)
+                if result >= 0 {
+                    return result
+                } else if errno != EINTR {
+                    throw Error(pattern: pattern, code: .FILE_ACCESS_ERROR)
+                }
+            }
+        }, bufferCapacity: bufferCapacity)
+    }
+
+}
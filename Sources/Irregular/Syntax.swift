@@ -0,0 +1,201 @@
+//
+//  Syntax.swift
+//  Irregular
+//
+
+/// A parsed pattern.
+///
+/// Nodes live in one contiguous arena and refer to each other by index;
+/// concatenations and alternations refer to a run of `children`. Every node
+/// has a span of UTF-16 offsets into the pattern it came from.
+struct SyntaxTree {
+
+    typealias NodeIndex = Int32
+
+    /// Mode flags in effect where a node was parsed, from the pattern's
+    /// options and any inline `(?ismwx-ismwx)` groups.
+    struct Flags: OptionSet {
+        let rawValue: UInt8
+
+        static let caseInsensitive = Flags(rawValue: 1 << 0)
+        static let dotMatchesLineSeparators = Flags(rawValue: 1 << 1)
+        static let anchorsMatchLines = Flags(rawValue: 1 << 2)
+        static let useUnixLineSeparators = Flags(rawValue: 1 << 3)
+        static let useUnicodeWordBoundaries = Flags(rawValue: 1 << 4)
+        static let allowCommentsAndWhitespace = Flags(rawValue: 1 << 5)
+
+        init(rawValue: UInt8) {
+            self.rawValue = rawValue
+        }
+
+        init(_ options: RegularExpression.Options) {
+            var flags = Flags()
+            if options.contains(.caseInsensitive) { flags.insert(.caseInsensitive) }
+            if options.contains(.dotMatchesLineSeparators) { flags.insert(.dotMatchesLineSeparators) }
+            if options.contains(.anchorsMatchLines) { flags.insert(.anchorsMatchLines) }
+            if options.contains(.useUnixLineSeparators) { flags.insert(.useUnixLineSeparators) }
+            if options.contains(.useUnicodeWordBoundaries) { flags.insert(.useUnicodeWordBoundaries) }
+            if options.contains(.allowCommentsAndWhitespace) { flags.insert(.allowCommentsAndWhitespace) }
+            self = flags
+        }
+    }
+
+    /// Pattern features that some engines can't support.
+    struct Features: OptionSet {
+        let rawValue: UInt16
+
+        static let backreferences = Features(rawValue: 1 << 0)
+        static let lookahead = Features(rawValue: 1 << 1)
+        static let lookbehind = Features(rawValue: 1 << 2)
+        static let atomicGroups = Features(rawValue: 1 << 3)
+        static let previousMatchAnchor = Features(rawValue: 1 << 4)
+        static let graphemeClusters = Features(rawValue: 1 << 5)
+        static let unicodeWordBoundaries = Features(rawValue: 1 << 6)
+        /// A run of case-insensitive literals with a character ICU folds to
+        /// several, like `(?i)strasse`, which ICU matches against `straße`.
+        static let fullCaseFolding = Features(rawValue: 1 << 7)
+        /// A `.` that matches line terminators, which ICU lets match a CRLF
+        /// as one character, and never only its `\r`.
+        static let dotMatchingCRLF = Features(rawValue: 1 << 8)
+
+        init(rawValue: UInt16) {
+            self.rawValue = rawValue
+        }
+    }
+
+    enum Assertion {
+        /// `\A`, or `^` without `anchorsMatchLines`.
+        case startOfText
+        /// `\z`.
+        case endOfText
+        /// `\Z`, or `$` without `anchorsMatchLines`: the end of the text, or
+        /// before a line terminator that ends it.
+        case endOfTextOrBeforeFinalTerminator(unixLines: Bool)
+        /// `^` with `anchorsMatchLines`.
+        case startOfLine(unixLines: Bool)
+        /// `$` with `anchorsMatchLines`.
+        case endOfLine(unixLines: Bool)
+        /// `\b`.
+        case wordBoundary
+        /// `\B`.
+        case notWordBoundary
+        /// `\G`.
+        case previousMatchEnd
+    }
+
+    enum Repetition {
+        case greedy
+        case lazy
+        case possessive
+    }
+
+    enum Lookaround {
+        case ahead
+        case negativeAhead
+        case behind
+        case negativeBehind
+    }
+
+    enum Node {
+        case empty
+        /// A single code point; if case-insensitive, any code point equal to
+        /// it under case folding.
+        case literal(UInt32, caseInsensitive: Bool)
+        /// An index into `sets`. Case closure and negation are already applied.
+        case set(Int32)
+        case assertion(Assertion)
+        /// A capture group's number and contents.
+        case capture(Int32, NodeIndex)
+        /// A run of `children`.
+        case concatenation(Int32, Int32)
+        /// A run of `children`, in order of priority.
+        case alternation(Int32, Int32)
+        /// Repeated contents, at least `min` and at most `max` times, or
+        /// unbounded if `max` is negative.
+        case repetition(NodeIndex, min: Int32, max: Int32, Repetition)
+        case lookaround(NodeIndex, Lookaround)
+        case atomic(NodeIndex)
+        /// A capture group's number.
+        case backreference(Int32, caseInsensitive: Bool)
+        /// `\X`.
+        case graphemeCluster
+    }
+
+    private(set) var nodes = ContiguousArray<Node>()
+    private(set) var spans = ContiguousArray<Range<Int32>>()
+    private(set) var children = ContiguousArray<NodeIndex>()
+    private(set) var sets = [ScalarSet]()
+    var root: NodeIndex = 0
+    var captureCount = 0
+    var captureNames = [String: Int]()
+    var features = Features()
+
+    /// Code points that any number of may come before a match, which a
+    /// search anchored where the text starts may skip. A leading `.*` is
+    /// moved here for searches that only need to know whether there's a
+    /// match.
+    var unanchoredPrefix: ScalarSet?
+
+    subscript(node: NodeIndex) -> Node {
+        return nodes[Int(node)]
+    }
+
+    func span(of node: NodeIndex) -> Range<Int32> {
+        return spans[Int(node)]
+    }
+
+    func children(from start: Int32, to end: Int32) -> ArraySlice<NodeIndex> {
+        return children[Int(start) ..< Int(end)]
+    }
+
+    func set(at index: Int32) -> ScalarSet {
+        return sets[Int(index)]
+    }
+
+    mutating func add(_ node: Node, span: Range<Int32>) -> NodeIndex {
+        nodes.append(node)
+        spans.append(span)
+        return NodeIndex(nodes.count - 1)
+    }
+
+    mutating func addChildren<C: Collection>(_ nodes: C) -> (Int32, Int32) where C.Iterator.Element == NodeIndex {
+        let start = Int32(children.count)
+        children.append(contentsOf: nodes)
+        return (start, Int32(children.count))
+    }
+
+    mutating func add(_ set: ScalarSet) -> Int32 {
+        if let existing = sets.index(of: set) {
+            return Int32(existing)
+        }
+        sets.append(set)
+        return Int32(sets.count - 1)
+    }
+
+}
+
+extension SyntaxTree {
+
+    /// Whether a repetition that can repeat more than once is inside an
+    /// unbounded one, as in `(a+)*`: the shape that lets a backtracker try
+    /// exponentially many ways to divide the text between them.
+    var hasNestedUnboundedRepetition: Bool {
+        func visit(_ node: NodeIndex, insideUnbounded: Bool) -> Bool {
+            switch self[node] {
+            case let .repetition(body, _, max, _):
+                if insideUnbounded && (max < 0 || max > 1) {
+                    return true
+                }
+                return visit(body, insideUnbounded: insideUnbounded || max < 0)
+            case .capture(_, let body), .lookaround(let body, _), .atomic(let body):
+                return visit(body, insideUnbounded: insideUnbounded)
+            case .concatenation(let start, let end), .alternation(let start, let end):
+                return children(from: start, to: end).contains { visit($0, insideUnbounded: insideUnbounded) }
+            default:
+                return false
+            }
+        }
+        return visit(root, insideUnbounded: false)
+    }
+
+}
@@ -245,6 +245,25 @@ extension String.UTF16View: UTextable {
 
 extension String {
 
+    /// Creates a string by decoding `units` as UTF-16, substituting U+FFFD for
+    /// unpaired surrogates.
+    init<C: Collection>(decodingUTF16 units: C) where C.Iterator.Element == UInt16 {
+        var scalars = String.UnicodeScalarView()
+        var iterator = units.makeIterator()
+        var codec = UTF16()
+        decoding: while true {
+            switch codec.decode(&iterator) {
+            case .scalarValue(let scalar):
+                scalars.append(scalar)
+            case .error:
+                scalars.append("\u{FFFD}")
+            case .emptyInput:
+                break decoding
+            }
+        }
+        self.init(scalars)
+    }
+
     func withUText<R>(_ body: (UnsafeMutablePointer<UText>) throws -> R) rethrows -> R {
         return try utf16.withUText(body)
     }
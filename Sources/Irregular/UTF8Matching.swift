@@ -0,0 +1,411 @@
+//
+//  UTF8Matching.swift
+//  Irregular
+//
+
+import Dispatch
+
+/// UTF-8 text for programs translated with `Program(utf8:)`, which consume
+/// it a byte at a time. Offsets are byte offsets.
+struct UTF8SearchInput: SearchText {
+
+    let bytes: UnsafeBufferPointer<UInt8>
+
+    let start: Int
+    let end: Int
+
+    let anchorStart: Int
+    let anchorEnd: Int
+
+    let lookStart: Int
+    let lookEnd: Int
+
+    init(bytes: UnsafeBufferPointer<UInt8>, start: Int, end: Int, options: RegularExpression.MatchingOptions) {
+        self.bytes = bytes
+        self.start = start
+        self.end = end
+        let anchoring = !options.contains(.withoutAnchoringBounds)
+        self.anchorStart = anchoring ? start : 0
+        self.anchorEnd = anchoring ? end : bytes.count
+        let transparent = options.contains(.withTransparentBounds)
+        self.lookStart = transparent ? 0 : start
+        self.lookEnd = transparent ? bytes.count : end
+    }
+
+    private init(_ other: UTF8SearchInput, start: Int, end: Int) {
+        self.bytes = other.bytes
+        self.start = start
+        self.end = end
+        self.anchorStart = other.anchorStart
+        self.anchorEnd = other.anchorEnd
+        self.lookStart = other.lookStart
+        self.lookEnd = other.lookEnd
+    }
+
+    func bounded(from start: Int, to end: Int) -> UTF8SearchInput {
+        return UTF8SearchInput(self, start: start, end: end)
+    }
+
+    func scalar(at i: Int, limit: Int) -> (value: UInt32, width: Int) {
+        return (UInt32(bytes[i]), 1)
+    }
+
+    func scalar(before i: Int, limit: Int) -> (value: UInt32, width: Int) {
+        return (UInt32(bytes[i - 1]), 1)
+    }
+
+    /// Decodes the code point at `i`; each ill-formed byte is U+FFFD.
+    func decode(at i: Int, limit: Int) -> (value: UInt32, width: Int) {
+        let lead = bytes[i]
+        let length: Int
+        let minimumSecond: UInt8, maximumSecond: UInt8
+        switch lead {
+        case 0x00 ... 0x7F:
+            return (UInt32(lead), 1)
+        case 0xC2 ... 0xDF:
+            (length, minimumSecond, maximumSecond) = (2, 0x80, 0xBF)
+        case 0xE0:
+            (length, minimumSecond, maximumSecond) = (3, 0xA0, 0xBF)
+        case 0xED:
+            (length, minimumSecond, maximumSecond) = (3, 0x80, 0x9F)
+        case 0xE1 ... 0xEF:
+            (length, minimumSecond, maximumSecond) = (3, 0x80, 0xBF)
+        case 0xF0:
+            (length, minimumSecond, maximumSecond) = (4, 0x90, 0xBF)
+        case 0xF4:
+            (length, minimumSecond, maximumSecond) = (4, 0x80, 0x8F)
+        case 0xF1 ... 0xF3:
+            (length, minimumSecond, maximumSecond) = (4, 0x80, 0xBF)
+        default:
+            return (0xFFFD, 1)
+        }
+
+        var scalar = UInt32(lead) & (0xFF >> UInt32(length + 1))
+        for j in 1 ..< length {
+            guard i + j < limit else { return (0xFFFD, 1) }
+            let byte = bytes[i + j]
+            guard byte >= (j == 1 ? minimumSecond : 0x80) && byte <= (j == 1 ? maximumSecond : 0xBF) else { return (0xFFFD, 1) }
+            scalar = (scalar << 6) | (UInt32(byte) & 0x3F)
+        }
+        return (scalar, length)
+    }
+
+    /// Decodes the code point that ends at `i`.
+    func decode(before i: Int, limit: Int) -> (value: UInt32, width: Int) {
+        // A lead byte at most three continuation bytes back, whose sequence
+        // ends exactly at `i`.
+        var lead = i - 1
+        while lead > limit && lead > i - 4 && bytes[lead] & 0xC0 == 0x80 {
+            lead -= 1
+        }
+        let decoded = decode(at: lead, limit: i)
+        return lead + decoded.width == i ? decoded : (0xFFFD, 1)
+    }
+
+    /// Whether `i` is between code points rather than inside one, with each
+    /// ill-formed byte a code point of its own.
+    func isCodePointBoundary(at i: Int) -> Bool {
+        guard i > 0 && i < bytes.count && bytes[i] & 0xC0 == 0x80 else { return true }
+        // Inside a code point if a lead byte at most three bytes back begins
+        // a well-formed sequence that runs past `i`.
+        var lead = i - 1
+        while lead > 0 && lead > i - 3 && bytes[lead] & 0xC0 == 0x80 {
+            lead -= 1
+        }
+        return lead + decode(at: lead, limit: bytes.count).width <= i
+    }
+
+    /// The length of the line terminator ending at `i`, or 0.
+    private func terminatorLength(before i: Int) -> Int {
+        switch bytes[i - 1] {
+        case 0x0A ... 0x0D:
+            return 1
+        case 0x85 where i - 2 >= 0 && bytes[i - 2] == 0xC2:
+            return 2
+        case 0xA8, 0xA9:
+            return i - 3 >= 0 && bytes[i - 3] == 0xE2 && bytes[i - 2] == 0x80 ? 3 : 0
+        default:
+            return 0
+        }
+    }
+
+    /// The length of the line terminator starting at `i`, or 0.
+    private func terminatorLength(at i: Int) -> Int {
+        switch bytes[i] {
+        case 0x0A ... 0x0D:
+            return 1
+        case 0xC2 where i + 1 < bytes.count && bytes[i + 1] == 0x85:
+            return 2
+        case 0xE2 where i + 2 < bytes.count && bytes[i + 1] == 0x80 && (bytes[i + 2] == 0xA8 || bytes[i + 2] == 0xA9):
+            return 3
+        default:
+            return 0
+        }
+    }
+
+    private func isWordBoundary(at i: Int) -> Bool {
+        var isWordAfter = false
+        if i < lookEnd {
+            let after = decode(at: i, limit: lookEnd).value
+            if ScalarSet.wordBoundaryTransparent.contains(after) {
+                return false
+            }
+            isWordAfter = ScalarSet.word.contains(after)
+        }
+
+        var isWordBefore = false
+        var position = i
+        while position > lookStart {
+            let (before, width) = decode(before: position, limit: lookStart)
+            position -= width
+            if !ScalarSet.wordBoundaryTransparent.contains(before) {
+                isWordBefore = ScalarSet.word.contains(before)
+                break
+            }
+        }
+
+        return isWordAfter != isWordBefore
+    }
+
+    /// Whether `assertion` holds at `i`. Unanchored searches try every byte,
+    /// so none holds inside a code point, where ICU never looks.
+    func holds(_ assertion: SyntaxTree.Assertion, at i: Int) -> Bool {
+        guard i == start || i == end || isCodePointBoundary(at: i) else { return false }
+        switch assertion {
+        case .startOfText:
+            return i == anchorStart
+        case .endOfText:
+            return i == anchorEnd
+        case .endOfTextOrBeforeFinalTerminator(let unixLines):
+            if i == anchorEnd {
+                return true
+            } else if unixLines {
+                return i + 1 == anchorEnd && bytes[i] == 0x0A
+            } else {
+                // Like ICU, not between the `\r` and `\n` of a final CRLF.
+                return (i + terminatorLength(at: i) == anchorEnd && !(bytes[i] == 0x0A && i > lookStart && bytes[i - 1] == 0x0D)) ||
+                    (i + 2 == anchorEnd && bytes[i] == 0x0D && bytes[i + 1] == 0x0A)
+            }
+        case .startOfLine(let unixLines):
+            if i == anchorStart {
+                return true
+            } else if i >= anchorEnd {
+                return false
+            }
+            if unixLines {
+                return bytes[i - 1] == 0x0A
+            }
+            return terminatorLength(before: i) > 0 && !(bytes[i - 1] == 0x0D && bytes[i] == 0x0A)
+        case .endOfLine(let unixLines):
+            if i >= anchorEnd {
+                return true
+            }
+            if unixLines {
+                return bytes[i] == 0x0A
+            }
+            return terminatorLength(at: i) > 0 && !(bytes[i] == 0x0A && i > lookStart && bytes[i - 1] == 0x0D)
+        case .wordBoundary:
+            return isWordBoundary(at: i)
+        case .notWordBoundary:
+            return !isWordBoundary(at: i)
+        case .previousMatchEnd:
+            preconditionFailure("\\G is not compiled for the native engines")
+        }
+    }
+
+}
+
+/// The pattern compiled to consume UTF-8, with DFAs to find match spans and
+/// the Pike VM to resolve capture groups.
+final class UTF8Searcher {
+
+    let program: Program
+    private let dfa: DFASearcher?
+
+    init?(program: Program, syntax: SyntaxTree, dfaCacheCapacity: Int) {
+        guard let translated = Program(utf8: program) else { return nil }
+        self.program = translated
+        if LazyDFA.supports(translated, direction: .forward) {
+            let reverse = Program(syntax, reversed: true).flatMap { Program(utf8: $0) }.flatMap {
+                LazyDFA.supports($0, direction: .reverse) ? DFAPool(program: $0, direction: .reverse, capacity: dfaCacheCapacity / 2) : nil
+            }
+            self.dfa = DFASearcher(forward: DFAPool(program: translated, direction: .forward, capacity: dfaCacheCapacity / 2), reverse: reverse)
+        } else {
+            self.dfa = nil
+        }
+    }
+
+    func containsMatch(in input: UTF8SearchInput, anchored: Bool, monitor: SearchMonitor?) -> Bool {
+        if let dfa = dfa {
+            switch dfa.containsMatch(in: input, from: input.start, anchored: anchored, monitor: monitor) {
+            case .match:
+                return true
+            case .noMatch:
+                return false
+            case .gaveUp:
+                break
+            }
+        }
+        return PikeVM(program: program).search(input, from: input.start, anchored: anchored, monitor: monitor) != nil
+    }
+
+    /// Returns the byte offsets of the first match at or after `start`, and
+    /// of its capture groups if `needsCaptures`, in pairs.
+    ///
+    /// Matches only begin between code points. The automata try every byte,
+    /// but the only match they can find inside a code point is an empty one
+    /// that could begin anywhere, so the search moves on to the next code
+    /// point.
+    func search(_ input: UTF8SearchInput, from start: Int, anchored: Bool, needsCaptures: Bool, monitor: SearchMonitor?) -> ContiguousArray<Int>? {
+        var start = start
+        while let slots = searchBytes(input, from: start, anchored: anchored, needsCaptures: needsCaptures, monitor: monitor) {
+            guard !anchored, slots[0] > input.start, slots[0] < input.end, !input.isCodePointBoundary(at: slots[0]) else { return slots }
+            start = slots[0] + 1
+            while start < input.end && !input.isCodePointBoundary(at: start) {
+                start += 1
+            }
+        }
+        return nil
+    }
+
+    private func searchBytes(_ input: UTF8SearchInput, from start: Int, anchored: Bool, needsCaptures: Bool, monitor: SearchMonitor?) -> ContiguousArray<Int>? {
+        if let dfa = dfa {
+            switch dfa.span(in: input, from: start, anchored: anchored, monitor: monitor) {
+            case .found(let span):
+                guard needsCaptures && program.captureCount > 0 else { return [span.lowerBound, span.upperBound] }
+                let slots = PikeVM(program: program).search(input.bounded(from: span.lowerBound, to: span.upperBound), from: span.lowerBound, anchored: true, monitor: monitor)
+                if let slots = slots, slots[1] == span.upperBound {
+                    return slots
+                }
+            case .none:
+                return nil
+            case .gaveUp:
+                break
+            }
+        }
+        return PikeVM(program: program).search(input, from: start, anchored: anchored, monitor: monitor)
+    }
+
+}
+
+/// Builds a `UTF8Searcher` the first time UTF-8 text is searched, so
+/// expressions only ever used on strings don't pay for it.
+final class LazyUTF8Searcher {
+
+    private let program: Program?
+    private let syntax: SyntaxTree?
+    private let dfaCacheCapacity: Int
+    private let semaphore = DispatchSemaphore(value: 1)
+    private var isBuilt = false
+    private var built: UTF8Searcher?
+
+    init(program: Program?, syntax: SyntaxTree?, dfaCacheCapacity: Int) {
+        self.program = program
+        self.syntax = syntax
+        self.dfaCacheCapacity = dfaCacheCapacity
+    }
+
+    var searcher: UTF8Searcher? {
+        semaphore.wait()
+        defer { semaphore.signal() }
+        if !isBuilt {
+            if let program = program, let syntax = syntax {
+                built = UTF8Searcher(program: program, syntax: syntax, dfaCacheCapacity: dfaCacheCapacity)
+            }
+            isBuilt = true
+        }
+        return built
+    }
+
+}
+
+extension RegularExpression {
+
+    private func utf8Input(_ bytes: UnsafeBufferPointer<UInt8>, options: MatchingOptions, range: Range<Int>?) -> UTF8SearchInput {
+        let region = range ?? 0 ..< bytes.count
+        precondition(region.lowerBound >= 0 && region.upperBound <= bytes.count, "range is out of bounds")
+        return UTF8SearchInput(bytes: bytes, start: region.lowerBound, end: region.upperBound, options: options)
+    }
+
+    private func utf8Searcher() throws -> UTF8Searcher {
+        guard let searcher = utf8.searcher else {
+            throw Error(pattern: pattern, code: .UNSUPPORTED_ERROR)
+        }
+        return searcher
+    }
+
+    /// Returns whether the UTF-8 text `bytes` contains a match.
+    ///
+    /// The pattern is compiled to automata over bytes, so the text is matched
+    /// where it is, without transcoding it to UTF-16 for ICU. Ill-formed
+    /// bytes never match any character. Patterns that need ICU, like those
+    /// with backreferences or look-around, throw `UNSUPPORTED_ERROR`.
+    ///
+    /// - parameter range: The byte offsets to search, or `nil` for all of
+    ///   `bytes`.
+    public func containsMatch(inUTF8 bytes: UnsafeBufferPointer<UInt8>, options: MatchingOptions = [], range: Range<Int>? = nil, limits: MatchLimits = MatchLimits()) throws -> Bool {
+        let searcher = try utf8Searcher()
+        let monitor = limits.isUnlimited ? nil : SearchMonitor(limits: limits)
+        monitor?.beginSearch()
+        let found = searcher.containsMatch(in: utf8Input(bytes, options: options, range: range), anchored: options.contains(.anchored), monitor: monitor)
+        if let interruption = monitor?.interruption {
+            throw Error(pattern: pattern, interruption: interruption)
+        }
+        return found
+    }
+
+    /// Returns the byte offsets of the matches in the UTF-8 text `bytes`,
+    /// without their capture groups.
+    ///
+    /// Like `containsMatch(inUTF8:)`, this matches the bytes directly.
+    public func matchRanges(inUTF8 bytes: UnsafeBufferPointer<UInt8>, options: MatchingOptions = [], range: Range<Int>? = nil, limits: MatchLimits = MatchLimits()) throws -> [Range<Int>] {
+        let searcher = try utf8Searcher()
+        let monitor = limits.isUnlimited ? nil : SearchMonitor(limits: limits)
+        let input = utf8Input(bytes, options: options, range: range)
+        let isAnchored = options.contains(.anchored)
+        monitor?.beginSearch()
+
+        // Like ICU, the search after an empty match begins one code point
+        // later, and an anchored search matches at most once.
+        var ranges = [Range<Int>]()
+        var position = input.start
+        while let slots = searcher.search(input, from: position, anchored: isAnchored, needsCaptures: false, monitor: monitor) {
+            ranges.append(slots[0] ..< slots[1])
+            if isAnchored {
+                break
+            } else if slots[0] < slots[1] {
+                position = slots[1]
+            } else if slots[1] < input.end {
+                position = slots[1] + input.decode(at: slots[1], limit: input.end).width
+            } else {
+                break
+            }
+        }
+        if let interruption = monitor?.interruption {
+            throw Error(pattern: pattern, interruption: interruption)
+        }
+        return ranges
+    }
+
+    /// Returns the byte offsets of the first match in the UTF-8 text `bytes`
+    /// and of its capture groups, with `nil` for groups that didn't
+    /// participate, or `nil` if there is no match.
+    ///
+    /// Like `containsMatch(inUTF8:)`, this matches the bytes directly.
+    public func firstMatch(inUTF8 bytes: UnsafeBufferPointer<UInt8>, options: MatchingOptions = [], range: Range<Int>? = nil, limits: MatchLimits = MatchLimits()) throws -> [Range<Int>?]? {
+        let searcher = try utf8Searcher()
+        let monitor = limits.isUnlimited ? nil : SearchMonitor(limits: limits)
+        let input = utf8Input(bytes, options: options, range: range)
+        monitor?.beginSearch()
+        let slots = searcher.search(input, from: input.start, anchored: options.contains(.anchored), needsCaptures: true, monitor: monitor)
+        if let interruption = monitor?.interruption {
+            throw Error(pattern: pattern, interruption: interruption)
+        }
+        return slots.map { (slots) -> [Range<Int>?] in
+            stride(from: 0, to: slots.count, by: 2).map { (i) -> Range<Int>? in
+                slots[i] >= 0 && slots[i + 1] >= slots[i] ? slots[i] ..< slots[i + 1] : nil
+            }
+        }
+    }
+
+}
@@ -0,0 +1,92 @@
+//
+//  UTF8Sequences.swift
+//  Irregular
+//
+
+/// The UTF-8 byte sequences that encode a set of code points, as ranges of
+/// bytes, in the manner of RE2's and Rust's UTF-8 compilers.
+///
+/// A range of code points encodes as a few sequences in which each byte may
+/// be anything in its range independently: `[\u{80}-\u{7FF}]` is
+/// `[C2-DF][80-BF]`, while `[\u{7FF}-\u{800}]` splits into `[DF][BF]` and
+/// `[E0][A0][80]`.
+struct UTF8Sequences: Sequence {
+
+    struct ByteRange {
+        var lower: UInt8
+        var upper: UInt8
+    }
+
+    /// The largest code point encoded in each length of sequence.
+    private static let maximumScalars: [UInt32] = [0x7F, 0x7FF, 0xFFFF, 0x10FFFF]
+
+    private static let surrogates = ScalarSet([0xD800 ... 0xDFFF])
+
+    private var sequences = [[ByteRange]]()
+
+    init(_ set: ScalarSet) {
+        for range in set.subtracting(UTF8Sequences.surrogates).ranges {
+            split(range.lowerBound, range.upperBound)
+        }
+    }
+
+    /// Returns the UTF-8 encoding of `scalar`, or nothing for a surrogate.
+    static func encode(_ scalar: UInt32) -> [UInt8] {
+        switch scalar {
+        case 0 ... 0x7F:
+            return [UInt8(scalar)]
+        case 0x80 ... 0x7FF:
+            return [UInt8(0xC0 | scalar >> 6), UInt8(0x80 | scalar & 0x3F)]
+        case 0xD800 ... 0xDFFF:
+            return []
+        case 0x800 ... 0xFFFF:
+            return [UInt8(0xE0 | scalar >> 12), UInt8(0x80 | scalar >> 6 & 0x3F), UInt8(0x80 | scalar & 0x3F)]
+        default:
+            return [UInt8(0xF0 | scalar >> 18), UInt8(0x80 | scalar >> 12 & 0x3F), UInt8(0x80 | scalar >> 6 & 0x3F), UInt8(0x80 | scalar & 0x3F)]
+        }
+    }
+
+    /// Splits `first ... last` until each piece's first and last code points
+    /// encode to the same length and differ only in bytes that span every
+    /// continuation byte, so each byte's range is independent of the others.
+    private mutating func split(_ first: UInt32, _ last: UInt32) {
+        var pending = [(first, last)]
+        pieces: while var (start, end) = pending.popLast() {
+            splitting: while true {
+                for maximum in UTF8Sequences.maximumScalars where start <= maximum && maximum < end {
+                    pending.append((maximum + 1, end))
+                    end = maximum
+                    continue splitting
+                }
+
+                guard end > 0x7F else {
+                    sequences.append([ByteRange(lower: UInt8(start), upper: UInt8(end))])
+                    continue pieces
+                }
+
+                for i: UInt32 in 1 ..< 4 {
+                    let mask: UInt32 = (1 << (6 * i)) - 1
+                    guard start & ~mask != end & ~mask else { continue }
+                    if start & mask != 0 {
+                        pending.append(((start | mask) + 1, end))
+                        end = start | mask
+                        continue splitting
+                    } else if end & mask != mask {
+                        pending.append((end & ~mask, end))
+                        end = (end & ~mask) - 1
+                        continue splitting
+                    }
+                }
+
+                let lower = UTF8Sequences.encode(start), upper = UTF8Sequences.encode(end)
+                sequences.append(zip(lower, upper).map { ByteRange(lower: $0, upper: $1) })
+                continue pieces
+            }
+        }
+    }
+
+    func makeIterator() -> IndexingIterator<[[ByteRange]]> {
+        return sequences.makeIterator()
+    }
+
+}
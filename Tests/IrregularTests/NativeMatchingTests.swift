@@ -0,0 +1,172 @@
+//
+//  NativeMatchingTests.swift
+//  IrregularTests
+//
+
+import XCTest
+import CUnicode
+@testable import Irregular
+
+/// Compares the native engines with ICU, which matched every pattern before
+/// them: each pattern is matched against each text with ICU alone and with
+/// the engines `matches(in:)` and `containsMatch(in:)` choose, and the
+/// matches and their capture groups must be the same.
+final class NativeMatchingTests: XCTestCase {
+
+    static var allTests: [(String, (NativeMatchingTests) -> () throws -> Void)] {
+        return [
+            ("testMatchesAgreeWithICU", testMatchesAgreeWithICU),
+            ("testMatchesInRegionsAgreeWithICU", testMatchesInRegionsAgreeWithICU),
+            ("testCaseInsensitiveMatchesAgreeWithICU", testCaseInsensitiveMatchesAgreeWithICU),
+            ("testUTF8MatchesAgreeWithICU", testUTF8MatchesAgreeWithICU),
+        ]
+    }
+
+    static let patterns = [
+        // Literals and fixed sequences.
+        "a", "abc", "foo", "😀", ".😀", "\\d{3}-\\d{4}", "[a-c][0-9]",
+        // Empty matches.
+        "", "a*", "x*", "a??", "(?:ab)*", "\\b", "\\B", "^", "$", "\\Z", "\\z",
+        // Ends of lines and text, including CRLF.
+        "\\r$", "\\r\\Z", "\\n$", "$\\n?", "\\w+$", "\\w+\\Z", "(?m)^\\w+$", "(?m)$", "(?m)^", "\\A\\w+", "\\w\\z",
+        // Word boundaries.
+        "\\bfoo\\b", "\\b\\w+\\b", "\\B\\w", "\\bcaf",
+        // Alternation and capture groups, some that don't participate.
+        "(a|ab)(c|bcd)(d*)", "(a)|(b)", "(foo|bar|baz)", "(\\d+)\\.(\\d+)", "(a*)(b*)", "((a)|b)+", "(?:(a)|(x))c",
+        // Repetition, greedy and lazy.
+        "a+?", "a{2,3}", "[a-z]+", "[^a]+", "\\w+", "\\s+", "o+", ".*", ".", "(a+)+b", "(x+x+)+y", "\\p{L}+",
+        // Line and paragraph separators, and dots that match them.
+        "[\\u2028\\u2029]", "b$", "a.b", "(?s).", "(?s).+", "(?s)a.*\\nb", "(?s)a.\\nb", "(?s)\\r.",
+    ]
+
+    static let texts = [
+        "", "a", "b", "abc", "aaa", "abcd", "abcabc", "ab", "xxxxxxy", "aXbXc",
+        "foo bar baz", "foo123bar", "food foo.", "hello, world!", "the cat sat on the mat",
+        "555-1234 and 12-3456", "1,234.56 or 7.8", "a1 b2 c3",
+        "\r\n", "\r", "\n", "a\r\n", "a\r\nb", "end\r\n", "x\n\n", "line one\nline two\n", "one\r\ntwo\r\n",
+        "a\u{2028}b\u{2029}", "a\u{85}b", "café cafe\u{301}", "😀a😀", "\u{10000}x",
+        String(repeating: "foo bar ", count: 2_000) + "baz\r\n",
+    ]
+
+    /// Patterns whose case-insensitive matches ICU folds differently from
+    /// character to character, with text to match them against.
+    private static let caseInsensitiveCorpus: [(patterns: [String], texts: [String])] = [
+        (["(?i)strasse", "(?i)straße", "(?i)stra(ss)e", "(?i)ß", "(?i)ss"], ["Straße STRASSE strasse", "STRAẞE", "ss ß SS"]),
+        (["(?i)office", "(?i)oﬃce", "(?i)ffi", "(?i)f+"], ["oﬃce OFFICE office", "ﬀ ﬁ ﬃ"]),
+        (["(?i)σας", "(?i)Σ+", "(?i)k", "(?i)[a-z]+", "(?i)ABC", "(?i)é"], ["ΣΑΣ σας σάς", "\u{212A}elvin KELVIN", "abc ABC aBc", "CAFÉ café"]),
+    ]
+
+    /// The ways `matches(in:)` may be asked to search the whole text.
+    static let matchingOptions: [RegularExpression.MatchingOptions] = [[], [.anchored]]
+
+    /// The ways it may be asked to search a region of the text.
+    static let regionOptions: [RegularExpression.MatchingOptions] = [[], [.anchored], [.withTransparentBounds], [.withoutAnchoringBounds], [.withTransparentBounds, .withoutAnchoringBounds]]
+
+    /// The regular expressions for `pattern` to check against ICU: as
+    /// created by default, without the bounded backtracker, and with
+    /// linear-time matching if the pattern allows it.
+    private func nativeRegularExpressions(for pattern: String, options: RegularExpression.Options = []) throws -> [(String, RegularExpression)] {
+        var regexes = try [
+            ("default", RegularExpression(pattern: pattern, options: options)),
+            ("without backtracker", RegularExpression(pattern: pattern, options: options, backtrackingMemoryBudget: 0)),
+        ]
+        do {
+            let linearTime = try RegularExpression(pattern: pattern, options: options.union(.linearTime))
+            regexes.append(("linear time", linearTime))
+        } catch let error as RegularExpression.Error where error.code == Int(UErrorCode.UNSUPPORTED_ERROR.rawValue) {
+            // ICU will be used anyway.
+        }
+        return regexes
+    }
+
+    /// Describes every match of `regex` in `text`, with its capture groups,
+    /// as UTF-16 offsets.
+    private func describeMatches(of regex: RegularExpression, in text: String, options: RegularExpression.MatchingOptions, range: Range<String.Index>?) throws -> [String] {
+        func offset(_ index: String.Index) -> Int {
+            return text.utf16.distance(from: text.utf16.startIndex, to: index.samePosition(in: text.utf16))
+        }
+
+        var descriptions = [String]()
+        var matches = try regex.matches(in: text, options: options, range: range)
+        while let match = try matches.nextMatch() {
+            let groups = [match.range] + Array(match.ranges)
+            descriptions.append(groups.map({ "\(offset($0.lowerBound))..<\(offset($0.upperBound))" }).joined(separator: " "))
+            // More matches than code units means the search isn't advancing.
+            guard descriptions.count <= text.utf16.count + 1 else {
+                XCTFail("/\(regex.pattern)/ doesn't advance in \(text.debugDescription)")
+                break
+            }
+        }
+        return descriptions
+    }
+
+    private func checkAgreement(pattern: String, options: RegularExpression.Options = [], texts: [String], regions: Bool) throws {
+        let reference = try RegularExpression(pattern: pattern, options: options.union(.icuOnly))
+        for (variant, regex) in try nativeRegularExpressions(for: pattern, options: options) {
+            for text in texts {
+                let characters = text.characters
+                let ranges: [Range<String.Index>?] = regions && characters.count >= 2 ? [characters.index(after: characters.startIndex) ..< characters.index(before: characters.endIndex)] : [nil]
+                for range in ranges {
+                    for matchingOptions in range == nil ? NativeMatchingTests.matchingOptions : NativeMatchingTests.regionOptions {
+                        let context = "/\(pattern)/ (\(variant)) in \(text.debugDescription), options \(matchingOptions.rawValue), \(range == nil ? "whole text" : "region")"
+                        let expected = try describeMatches(of: reference, in: text, options: matchingOptions, range: range)
+                        let actual = try describeMatches(of: regex, in: text, options: matchingOptions, range: range)
+                        XCTAssertEqual(actual, expected, context)
+                        let containsMatch = try regex.containsMatch(in: text, options: matchingOptions, range: range)
+                        XCTAssertEqual(containsMatch, !expected.isEmpty, context)
+                    }
+                }
+            }
+        }
+    }
+
+    func testMatchesAgreeWithICU() throws {
+        for pattern in NativeMatchingTests.patterns {
+            try checkAgreement(pattern: pattern, texts: NativeMatchingTests.texts, regions: false)
+        }
+    }
+
+    func testMatchesInRegionsAgreeWithICU() throws {
+        for pattern in NativeMatchingTests.patterns {
+            try checkAgreement(pattern: pattern, texts: NativeMatchingTests.texts, regions: true)
+        }
+    }
+
+    func testCaseInsensitiveMatchesAgreeWithICU() throws {
+        for (patterns, texts) in NativeMatchingTests.caseInsensitiveCorpus {
+            for pattern in patterns {
+                try checkAgreement(pattern: pattern, texts: texts, regions: false)
+            }
+        }
+        for pattern in ["strasse", "office", "abc", "k"] {
+            try checkAgreement(pattern: pattern, options: .caseInsensitive, texts: ["Straße STRASSE", "oﬃce OFFICE", "aBC \u{212A}"], regions: false)
+        }
+    }
+
+    func testUTF8MatchesAgreeWithICU() throws {
+        for pattern in NativeMatchingTests.patterns {
+            let reference = try RegularExpression(pattern: pattern, options: .icuOnly)
+            let regex = try RegularExpression(pattern: pattern)
+            for text in NativeMatchingTests.texts {
+                var expected = [Range<Int>]()
+                var matches = try reference.matches(in: text)
+                while let match = try matches.nextMatch() {
+                    let start = text.utf8.distance(from: text.utf8.startIndex, to: match.range.lowerBound.samePosition(in: text.utf8))
+                    let end = text.utf8.distance(from: text.utf8.startIndex, to: match.range.upperBound.samePosition(in: text.utf8))
+                    expected.append(start ..< end)
+                }
+
+                let bytes = ContiguousArray(text.utf8)
+                let actual: [Range<Int>]
+                do {
+                    actual = try bytes.withUnsafeBufferPointer { try regex.matchRanges(inUTF8: $0) }
+                } catch let error as RegularExpression.Error where error.code == Int(UErrorCode.UNSUPPORTED_ERROR.rawValue) {
+                    // Only ICU can match the pattern.
+                    continue
+                }
+                XCTAssertEqual(actual, expected, "/\(pattern)/ in UTF-8 \(text.debugDescription)")
+            }
+        }
+    }
+
+}
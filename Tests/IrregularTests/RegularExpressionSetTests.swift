@@ -0,0 +1,63 @@
+//
+//  RegularExpressionSetTests.swift
+//  IrregularTests
+//
+
+import XCTest
+@testable import Irregular
+
+/// Checks that a set of regular expressions, matched in one pass with its
+/// literal filter, finds the same expressions as matching each on its own.
+final class RegularExpressionSetTests: XCTestCase {
+
+    static var allTests: [(String, (RegularExpressionSetTests) -> () throws -> Void)] {
+        return [
+            ("testMatchingIndicesAgreeWithExpressions", testMatchingIndicesAgreeWithExpressions),
+        ]
+    }
+
+    /// Every literal filter a set may use: bucket tables when there are few
+    /// enough literals, and Aho-Corasick with each representation.
+    private static let literalRepresentations: [AhoCorasick.Representation?] = [nil, .dense, .compact]
+
+    private func checkSet(_ set: RegularExpression.Set, variant: String, text: String, options: RegularExpression.MatchingOptions, range: Range<String.Index>?) throws {
+        let context = "\(variant) in \(text.debugDescription), options \(options.rawValue), \(range == nil ? "whole text" : "region")"
+        var expected = [Int]()
+        for (index, expression) in set.expressions.enumerated() {
+            if try expression.containsMatch(in: text, options: options, range: range) {
+                expected.append(index)
+            }
+        }
+        let actual = try set.matchingIndices(in: text, options: options, range: range)
+        XCTAssertEqual(actual.map { set.expressions[$0].pattern }, expected.map { set.expressions[$0].pattern }, context)
+        let containsMatch = try set.containsMatch(in: text, options: options, range: range)
+        XCTAssertEqual(containsMatch, !expected.isEmpty, context)
+    }
+
+    func testMatchingIndicesAgreeWithExpressions() throws {
+        let expressions = try NativeMatchingTests.patterns.map { try RegularExpression(pattern: $0) }
+        // The literal patterns alone have few enough literals for buckets.
+        let literalExpressions = try ["a", "abc", "foo", "😀", "(foo|bar|baz)", "\\bfoo\\b", "a.b"].map { try RegularExpression(pattern: $0) }
+        for representation in RegularExpressionSetTests.literalRepresentations {
+            let name = representation.map { "\($0)" } ?? "automatic"
+            let sets = [
+                ("all patterns, \(name) literals", RegularExpression.Set(expressions, literalRepresentation: representation)),
+                ("literal patterns, \(name) literals", RegularExpression.Set(literalExpressions, literalRepresentation: representation)),
+            ]
+            for (variant, set) in sets {
+                for text in NativeMatchingTests.texts {
+                    for options in NativeMatchingTests.matchingOptions {
+                        try checkSet(set, variant: variant, text: text, options: options, range: nil)
+                    }
+                    let characters = text.characters
+                    guard characters.count >= 2 else { continue }
+                    let region = characters.index(after: characters.startIndex) ..< characters.index(before: characters.endIndex)
+                    for options in NativeMatchingTests.regionOptions {
+                        try checkSet(set, variant: variant, text: text, options: options, range: region)
+                    }
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,130 @@
+//
+//  SerializationTests.swift
+//  IrregularTests
+//
+
+import XCTest
+import CUnicode
+@testable import Irregular
+
+/// Checks that regular expressions loaded from a blob match like the ones
+/// that were saved, and that blobs that weren't written by `serialize(_:)`
+/// are rejected.
+final class SerializationTests: XCTestCase {
+
+    static var allTests: [(String, (SerializationTests) -> () throws -> Void)] {
+        return [
+            ("testDeserializedMatchesAgree", testDeserializedMatchesAgree),
+            ("testDeserializedOptimizationsAgree", testDeserializedOptimizationsAgree),
+            ("testTruncatedBlobsAreInvalid", testTruncatedBlobsAreInvalid),
+            ("testBadMagicIsInvalid", testBadMagicIsInvalid),
+            ("testBadVersionIsInvalid", testBadVersionIsInvalid),
+        ]
+    }
+
+    /// Patterns the optimizer rewrites, ones only ICU matches, and one the
+    /// parser leaves to ICU, besides the native matching corpus.
+    private static let patterns = NativeMatchingTests.patterns + [
+        "foo|foobar|fob", "a|[bc]|d", "\\d++\\.", "(?:(?:a))", "(a)\\1", "(?<year>\\d{4})-(?<month>\\d{2})", "\\Gfoo", "(?<=a)b", "\\X", "\\N{LATIN SMALL LETTER A}+",
+    ]
+
+    /// A few patterns covering every kind of record, for checks that load a
+    /// blob once per byte.
+    private static let smallPatterns = ["(?<year>\\d{4})-(?<month>\\d{2})", "foo|foobar|fob", "(a)\\1|[^a-c]*?", "\\N{LATIN SMALL LETTER A}+"]
+
+    private func regularExpressions(for patterns: [String]) throws -> [RegularExpression] {
+        var regexes = try patterns.map { try RegularExpression(pattern: $0) }
+        regexes.append(try RegularExpression(pattern: "abc|x+", options: .caseInsensitive, dfaCacheCapacity: 1 << 16, backtrackingMemoryBudget: 0))
+        return regexes
+    }
+
+    /// Describes every match of `regex` in `text`, with its capture groups,
+    /// as UTF-16 offsets.
+    private func describeMatches(of regex: RegularExpression, in text: String) throws -> [String] {
+        func offset(_ index: String.Index) -> Int {
+            return text.utf16.distance(from: text.utf16.startIndex, to: index.samePosition(in: text.utf16))
+        }
+
+        var descriptions = [String]()
+        var matches = try regex.matches(in: text)
+        while let match = try matches.nextMatch() {
+            let groups = [match.range] + Array(match.ranges)
+            descriptions.append(groups.map({ "\(offset($0.lowerBound))..<\(offset($0.upperBound))" }).joined(separator: " "))
+        }
+        return descriptions
+    }
+
+    private func assertInvalidFormat(_ bytes: [UInt8], _ message: String) {
+        do {
+            _ = try RegularExpression.deserialize(bytes)
+            XCTFail("\(message) was loaded")
+        } catch let error as RegularExpression.Error {
+            XCTAssertEqual(error.code, Int(UErrorCode.INVALID_FORMAT_ERROR.rawValue), message)
+        } catch {
+            XCTFail("\(message) threw \(error)")
+        }
+    }
+
+    func testDeserializedMatchesAgree() throws {
+        let originals = try regularExpressions(for: SerializationTests.patterns)
+        let loaded = try RegularExpression.deserialize(RegularExpression.serialize(originals))
+        XCTAssertEqual(loaded.count, originals.count)
+        for (original, regex) in zip(originals, loaded) {
+            XCTAssertEqual(regex.pattern, original.pattern)
+            XCTAssertEqual(regex.options.rawValue, original.options.rawValue)
+            XCTAssertEqual(regex.dfaCacheCapacity, original.dfaCacheCapacity)
+            XCTAssertEqual(regex.backtrackingMemoryBudget, original.backtrackingMemoryBudget)
+            for text in NativeMatchingTests.texts {
+                let context = "/\(original.pattern)/ in \(text.debugDescription)"
+                let expected = try describeMatches(of: original, in: text)
+                let actual = try describeMatches(of: regex, in: text)
+                XCTAssertEqual(actual, expected, context)
+                let containsMatch = try regex.containsMatch(in: text)
+                XCTAssertEqual(containsMatch, !expected.isEmpty, context)
+            }
+        }
+
+        let single = try RegularExpression(serialized: RegularExpression.serialize([originals[0]]))
+        XCTAssertEqual(single.pattern, originals[0].pattern)
+    }
+
+    /// A loaded tree is optimized once, like a parsed one, so it reports the
+    /// same passes and compiles to the same engines.
+    func testDeserializedOptimizationsAgree() throws {
+        let originals = try regularExpressions(for: SerializationTests.patterns)
+        let loaded = try RegularExpression.deserialize(RegularExpression.serialize(originals))
+        for (original, regex) in zip(originals, loaded) {
+            let describe = { (regex: RegularExpression) in regex.optimizations.map { "\($0.pass.rawValue) \($0.rewrites): \($0.pattern)" } }
+            XCTAssertEqual(describe(regex), describe(original), original.pattern)
+            XCTAssertEqual(regex.syntax?.pattern, original.syntax?.pattern, original.pattern)
+            XCTAssertEqual(regex.program?.instructions.count, original.program?.instructions.count, original.pattern)
+            XCTAssertEqual("\(regex.engine)", "\(original.engine)", original.pattern)
+        }
+    }
+
+    func testTruncatedBlobsAreInvalid() throws {
+        let blob = RegularExpression.serialize(try regularExpressions(for: SerializationTests.smallPatterns))
+        for count in 0 ..< blob.count {
+            assertInvalidFormat(Array(blob[0 ..< count]), "a blob truncated to \(count) of \(blob.count) bytes")
+        }
+        assertInvalidFormat(blob + [0], "a blob with a byte after it")
+    }
+
+    func testBadMagicIsInvalid() throws {
+        var blob = RegularExpression.serialize(try regularExpressions(for: SerializationTests.smallPatterns))
+        blob[0] ^= 0xFF
+        assertInvalidFormat(blob, "a blob with the wrong magic number")
+    }
+
+    func testBadVersionIsInvalid() throws {
+        let blob = RegularExpression.serialize(try regularExpressions(for: SerializationTests.smallPatterns))
+        for version in [RegularExpression.serializationVersion - 1, RegularExpression.serializationVersion + 1] {
+            var altered = blob
+            for (offset, shift) in [0, 8, 16, 24].enumerated() {
+                altered[4 + offset] = UInt8(truncatingBitPattern: version >> UInt32(shift))
+            }
+            assertInvalidFormat(altered, "a blob of version \(version)")
+        }
+    }
+
+}
@@ -0,0 +1,8 @@
+import XCTest
+@testable import IrregularTests
+
+XCTMain([
+    testCase(NativeMatchingTests.allTests),
+    testCase(RegularExpressionSetTests.allTests),
+    testCase(SerializationTests.allTests),
+])